@@ -14,6 +14,7 @@
 
 #include "myfs.h"
 
+#include <limits.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
@@ -33,7 +34,10 @@ int installMyFS()
 
 
 
-int myfsIsIdle(Disk *d)
+// Cada funcao publica do myfs e implementada pela funcao de mesmo nome prefixada por __, que ela executa com fsLock
+// mantido, serializando as chamadas feitas por threads diferentes. Como a trava e recursiva, as implementacoes podem
+// chamar as funcoes publicas
+int __myfsIsIdle(Disk *d)
 {
     int i;
 
@@ -43,13 +47,31 @@ int myfsIsIdle(Disk *d)
         if(file != NULL && diskGetId(d) == diskGetId(file->disk)) return false;
     }
 
+    // O VFS so desmonta um disco ocioso, entao os checksums pendentes sao gravados e o contexto e descartado para que
+    // uma nova montagem leia o superbloco
+    MountInfo* mount = __getMountInfo(d);
+    if(mount != NULL && mount->checksumsDirty && !__saveChecksums(d)) return false;
+
+    __releaseMountInfo(d);
     return true;
 }
 
 
 
 
-int myfsFormat(Disk *d, unsigned int blockSize)
+int myfsIsIdle(Disk *d)
+{
+    __lockFs();
+    int result = __myfsIsIdle(d);
+    __unlockFs();
+
+    return result;
+}
+
+
+
+
+int __myfsFormat(Disk *d, unsigned int blockSize)
 {
     unsigned char superblock[DISK_SECTORDATASIZE] = {0};
 
@@ -73,12 +95,33 @@ int myfsFormat(Disk *d, unsigned int blockSize)
 
     ul2char(freeSpaceSector, &superblock[SUPERBLOCK_FREE_SPACE_SECTOR]);
 
-    unsigned int firstBlockSector = freeSpaceSector + freeSpaceSize;
-    unsigned int numBlocks        = (diskGetNumSectors(d) - firstBlockSector) / (blockSize / DISK_SECTORDATASIZE);
+    // A tabela de referencias guarda, para cada bloco, quantos arquivos alem do primeiro o compartilham. Fica no fim
+    // do disco, longe dos dados, ja que so e consultada para blocos de clones, e comeca zerada
+    unsigned int refCountSize = ((diskGetSize(d) / blockSize) + REFS_PER_SECTOR - 1) / REFS_PER_SECTOR;
+
+    // A area de checksums guarda um CRC32C por setor da area de blocos e tambem comeca zerada. Fica logo apos o mapa
+    // de bits, que e gravado nas mesmas operacoes
+    unsigned int checksumSector = freeSpaceSector + freeSpaceSize;
+    unsigned int checksumSize   = (diskGetNumSectors(d) - checksumSector - refCountSize + CHECKSUMS_PER_SECTOR - 1) /
+                                  CHECKSUMS_PER_SECTOR;
 
+    unsigned int firstBlockSector = checksumSector + checksumSize;
+    unsigned int numBlocks        = (diskGetNumSectors(d) - firstBlockSector - refCountSize) /
+                                    (blockSize / DISK_SECTORDATASIZE);
+    unsigned int refCountSector   = firstBlockSector + numBlocks * (blockSize / DISK_SECTORDATASIZE);
+
+    ul2char(refCountSector, &superblock[SUPERBLOCK_REFCOUNT_SECTOR]);
+    ul2char(checksumSector, &superblock[SUPERBLOCK_CHECKSUM_SECTOR]);
     ul2char(firstBlockSector, &superblock[SUPERBLOCK_FIRST_BLOCK_SECTOR]);
     ul2char(numBlocks, &superblock[SUPERBLOCK_NUM_BLOCKS]);
 
+    // Divide a area de blocos em grupos de CYLINDERS_PER_GROUP cilindros cada
+    unsigned int sectorsPerCylinder = diskGetNumSectors(d) / diskGetNumCylinders(d);
+    unsigned int blocksPerGroup = CYLINDERS_PER_GROUP * sectorsPerCylinder / (blockSize / DISK_SECTORDATASIZE);
+    if(blocksPerGroup == 0 || blocksPerGroup > numBlocks) blocksPerGroup = numBlocks;
+
+    ul2char(blocksPerGroup, &superblock[SUPERBLOCK_BLOCKS_PER_GROUP]);
+
     if(diskWriteSector(d, 0, superblock) == -1 ) return -1;
 
     unsigned char freeSpace[DISK_SECTORDATASIZE] = {0};
@@ -87,8 +130,20 @@ int myfsFormat(Disk *d, unsigned int blockSize)
         if(diskWriteSector(d, freeSpaceSector + i, freeSpace) == -1) return -1;
     }
 
+    for(i=0; i < checksumSize; i++)
+    {
+        if(diskWriteSector(d, checksumSector + i, freeSpace) == -1) return -1;
+    }
+
+    for(i=0; i < refCountSize; i++)
+    {
+        if(diskWriteSector(d, refCountSector + i, freeSpace) == -1) return -1;
+    }
+
+    __releaseMountInfo(d); // Superbloco e mapa de bits foram reescritos
+
     // Define um inode fixo como diretorio raiz
-    Inode* root = inodeLoad(ROOT_DIRECTORY_INODE, d);
+    Inode* root = __acquireInode(d, ROOT_DIRECTORY_INODE);
     if(root == NULL) return -1;
 
     inodeSetFileSize(root, 0);
@@ -99,7 +154,7 @@ int myfsFormat(Disk *d, unsigned int blockSize)
 
     if(rootBlock == 0 || inodeAddBlock(root, rootBlock) == -1)
     {
-        free(root);
+        __releaseInode(root);
         return -1;
     }
 
@@ -112,14 +167,17 @@ int myfsFormat(Disk *d, unsigned int blockSize)
     // Preserva um descritor de arquivo para poder usar sua posicao temporariamente
     // Nao chama a funcao __openRoot para que nao exista a possibilidade de falha
     FileInfo* previousFirstFD = openFiles[1-1];
-    openFiles[1-1] = malloc(sizeof(FileInfo));
-    openFiles[1-1]->disk = d;
-    openFiles[1-1]->diskBlockSize = blockSize;
-    openFiles[1-1]->inode = root;
-    openFiles[1-1]->currentByte = 0;
+    openFiles[1-1] = __newFileInfo(d, blockSize, root);
+
+    bool linked = __autoLink(1) && myfsLink(1, parent.filename, parent.inumber) != -1;
+
+    // As entradas . e .. ainda podem estar apenas no cache de bloco do descritor temporario
+    if(linked) linked = __flushBlockCache(openFiles[1-1]) && __saveChecksums(d);
+    free(openFiles[1-1]->cacheData);
 
-    if(!__autoLink(1) || myfsLink(1, parent.filename, parent.inumber) == -1)
+    if(!linked)
     {
+        __releaseInode(root);
         free(openFiles[1-1]);
         openFiles[1-1] = previousFirstFD;
 
@@ -130,14 +188,26 @@ int myfsFormat(Disk *d, unsigned int blockSize)
     openFiles[1-1] = previousFirstFD;
 
     inodeSave(root);
-    free(root);
+    __releaseInode(root);
     return numBlocks > 0 ? numBlocks : -1;
 }
 
 
 
 
-int myfsOpen(Disk *d, const char *path)
+int myfsFormat(Disk *d, unsigned int blockSize)
+{
+    __lockFs();
+    int result = __myfsFormat(d, blockSize);
+    __unlockFs();
+
+    return result;
+}
+
+
+
+
+int __myfsOpen(Disk *d, const char *path)
 {
     int lastBar;
     for(lastBar = strlen(path) - 1; lastBar >= 0 && path[lastBar] != '/'; lastBar--);
@@ -163,28 +233,25 @@ int myfsOpen(Disk *d, const char *path)
     {
         if(strcmp(entry.filename, path) == 0)
         {
-            Inode* inode = inodeLoad(entry.inumber, d);
+            Inode* inode = __acquireInode(d, entry.inumber);
             unsigned int blockSize = __getBlockSize(d);
             myfsClosedir(fd);
+            free(dirPath);
 
             if(inode == NULL || blockSize == 0)
             {
-                free(dirPath);
+                __releaseInode(inode);
                 return -1;
             }
 
-            openFiles[fd-1] = malloc(sizeof(FileInfo));
-            openFiles[fd-1]->disk = d;
-            openFiles[fd-1]->diskBlockSize = blockSize;
-            openFiles[fd-1]->inode = inode;
-            openFiles[fd-1]->currentByte = 0;
+            openFiles[fd-1] = __newFileInfo(d, blockSize, inode);
 
             return fd;
         }
     }
 
-    // Arquivo nao encontrado, cria um novo
-    unsigned int inumber = inodeFindFreeInode(ROOT_DIRECTORY_INODE + 1, d);
+    // Arquivo nao encontrado, cria um novo no grupo de cilindros do diretorio pai
+    unsigned int inumber = __findFreeInode(d, inodeGetNumber(openFiles[fd-1]->inode), false);
     if(inumber == 0)
     {
         myfsClosedir(fd);
@@ -192,7 +259,7 @@ int myfsOpen(Disk *d, const char *path)
         return -1;
     }
 
-    Inode* inode = inodeLoad(inumber, d);
+    Inode* inode = __acquireInode(d, inumber);
     if(inode == NULL)
     {
         myfsClosedir(fd);
@@ -204,10 +271,11 @@ int myfsOpen(Disk *d, const char *path)
     inodeSetRefCount(inode, 0);
     inodeSetFileSize(inode, 0);
 
-    unsigned int newFileFirstBlock = __findFreeBlock(d);
+    unsigned int allocated;
+    unsigned int newFileFirstBlock = __findFreeBlocks(d, __getGroupFirstBlock(d, inumber), 1, &allocated);
     if(newFileFirstBlock == 0)
     {
-        free(inode);
+        __releaseInode(inode);
         myfsClosedir(fd);
         free(dirPath);
         return -1;
@@ -215,7 +283,7 @@ int myfsOpen(Disk *d, const char *path)
 
     if(inodeAddBlock(inode, newFileFirstBlock) == -1)
     {
-        free(inode);
+        __releaseInode(inode);
         myfsClosedir(fd);
         free(dirPath);
         __setBlockFree(d, newFileFirstBlock);
@@ -226,28 +294,22 @@ int myfsOpen(Disk *d, const char *path)
     inodeSetRefCount(inode, 0);
     inodeSetFileType(inode, FILETYPE_REGULAR);
     inodeSave(inode);
-    free(inode);
 
+    // O inode continua em memoria durante o link, que atualiza seu contador de referencias no lugar
     if(myfsLink(fd, path, inumber) == -1)
     {
         myfsClosedir(fd);
         free(dirPath);
         __setBlockFree(d, newFileFirstBlock);
-        inode = inodeLoad(inumber, d);
         inodeClear(inode);
-        free(inode);
+        __releaseInode(inode);
         return -1;
     }
 
     myfsClosedir(fd);
 
     unsigned int blockSize = __getBlockSize(d);
-
-    openFiles[fd-1] = malloc(sizeof(FileInfo));
-    openFiles[fd-1]->disk = d;
-    openFiles[fd-1]->diskBlockSize = blockSize;
-    openFiles[fd-1]->inode = inodeLoad(inumber, d); // Carrega o inode novamente do disco para que o link tenha efeito
-    openFiles[fd-1]->currentByte = 0;
+    openFiles[fd-1] = __newFileInfo(d, blockSize, inode);
 
     free(dirPath);
     return fd;
@@ -256,54 +318,117 @@ int myfsOpen(Disk *d, const char *path)
 
 
 
-int myfsRead(int fd, char *buf, unsigned int nbytes)
+int myfsOpen(Disk *d, const char *path)
+{
+    __lockFs();
+    int result = __myfsOpen(d, path);
+    __unlockFs();
+
+    return result;
+}
+
+
+
+
+int __myfsRead(int fd, char *buf, unsigned int nbytes)
 {
     if(fd <= 0 || fd > MAX_FDS) return -1;
     FileInfo* file = openFiles[fd-1];
     if(file == NULL) return -1;
 
-    unsigned int inumber = inodeGetNumber(file->inode);
-    free(file->inode);
-    file->inode = inodeLoad(inumber, file->disk);
+    // Dados pendentes de outros descritores do mesmo arquivo sao gravados antes, para que a leitura os veja
+    if(!__flushOtherDelayedData(file)) return -1;
 
     unsigned int fileSize = inodeGetFileSize(file->inode);
     unsigned int bytesRead = 0;
     unsigned int currentInodeBlockNum = file->currentByte / file->diskBlockSize;
     unsigned int offset = file->currentByte % file->diskBlockSize; // offset em bytes a partir do início do bloco
-    unsigned int currentBlock = inodeGetBlockAddr(file->inode, currentInodeBlockNum);
-    unsigned char diskBuffer[DISK_SECTORDATASIZE];
+    unsigned int numFileBlocks = __getNumFileBlocks(file->inode, file->diskBlockSize);
+
+    // Bytes que podem ser lidos, limitados pelo pedido e pelo fim do arquivo
+    unsigned int bytesWanted = 0;
+    if(file->currentByte < fileSize)
+        bytesWanted = fileSize - file->currentByte < nbytes ? fileSize - file->currentByte : nbytes;
 
-    while(bytesRead < nbytes &&
-          bytesRead + file->currentByte < fileSize &&
-          currentBlock > 0)
+    // Uma leitura de arquivo comum que comeca onde a anterior terminou aumenta a janela de leitura antecipada
+    bool sequential = false;
+    if(inodeGetFileType(file->inode) == FILETYPE_REGULAR)
     {
-        unsigned int sectorsPerBlock = file->diskBlockSize / DISK_SECTORDATASIZE;
-        unsigned int firstSector = offset / DISK_SECTORDATASIZE;
-        unsigned int firstByteInSector = offset % DISK_SECTORDATASIZE;
+        sequential = file->currentByte == file->raNextByte;
 
-        int i;
-        for(i = firstSector; i < sectorsPerBlock && bytesRead < nbytes; i++)
+        if(!sequential) file->raWindow /= 2;
+        else if(file->raWindow < READ_AHEAD_MIN_BLOCKS) file->raWindow = READ_AHEAD_MIN_BLOCKS;
+        else if(file->raWindow < READ_AHEAD_MAX_BLOCKS) file->raWindow *= 2;
+    }
+
+    while(bytesRead < bytesWanted && currentInodeBlockNum < numFileBlocks)
+    {
+        unsigned int chunk = file->diskBlockSize - offset;
+        if(chunk > bytesWanted - bytesRead) chunk = bytesWanted - bytesRead;
+
+        bool inReadAhead = currentInodeBlockNum >= file->raStart &&
+                           currentInodeBlockNum < file->raStart + file->raCount;
+        if(sequential && !inReadAhead)
+        {
+            if(!__fillReadAhead(file, currentInodeBlockNum)) return -1;
+            inReadAhead = file->raCount > 0;
+        }
+
+        // Os enderecos dos blocos da leitura antecipada ja sao conhecidos, sem leitura das extensoes do inode
+        unsigned int currentBlock = inReadAhead ? file->raBlocks[currentInodeBlockNum - file->raStart] :
+                                                  __getFileBlockAddr(file, currentInodeBlockNum);
+        if(currentBlock == 0) break;
+
+        // Blocos trazidos pela leitura antecipada sao copiados dela. Buracos de arquivos esparsos leem como zeros, sem
+        // acesso ao disco. Setores inteiros sao lidos direto para buf; trechos desalinhados e blocos comprimidos
+        // carregam o bloco no cache do arquivo, de onde leituras pequenas e sequenciais sao atendidas sem acessar o
+        // disco
+        if(inReadAhead)
+        {
+            memcpy(&buf[bytesRead],
+                   &file->raData[(currentInodeBlockNum - file->raStart) * file->diskBlockSize + offset], chunk);
+        }
+        else if(currentBlock == HOLE_BLOCK) memset(&buf[bytesRead], 0, chunk);
+        else if(currentBlock == file->cacheBlock || (currentBlock & COMPRESSED_BLOCK_FLAG) ||
+                offset % DISK_SECTORDATASIZE != 0 || (offset + chunk) % DISK_SECTORDATASIZE != 0)
+        {
+            unsigned char* cache = __loadBlockCache(file, currentInodeBlockNum, currentBlock, false);
+            if(cache == NULL) return -1;
+
+            memcpy(&buf[bytesRead], &cache[offset], chunk);
+        }
+        else
         {
-            if(diskReadSector(file->disk, currentBlock + i, diskBuffer) == -1) return -1;
+            if(!__syncBlockCaches(file, currentBlock, false)) return -1;
 
-            int j;
-            for(j = firstByteInSector;  j < DISK_SECTORDATASIZE &&
-                                        bytesRead < nbytes &&
-                                        bytesRead + file->currentByte < fileSize;  j++)
+            unsigned int i;
+            for(i = 0; i < chunk / DISK_SECTORDATASIZE; i++)
             {
-                buf[bytesRead] = diskBuffer[j];
-                bytesRead++;
+                unsigned char* sector = (unsigned char*) &buf[bytesRead + i * DISK_SECTORDATASIZE];
+                unsigned int address = currentBlock + offset / DISK_SECTORDATASIZE + i;
+                if(__readBlockSector(file->disk, address, sector) == -1) return -1;
             }
-
-            firstByteInSector = 0;
         }
 
+        bytesRead += chunk;
         offset = 0;
         currentInodeBlockNum++;
-        currentBlock = inodeGetBlockAddr(file->inode, currentInodeBlockNum);
+    }
+
+    // Dados que ainda aguardam a alocacao atrasada sao lidos diretamente da memoria
+    unsigned int position = file->currentByte + bytesRead;
+    if(file->delayedSize > 0 && bytesRead < nbytes &&
+       position >= file->delayedStart && position < file->delayedStart + file->delayedSize)
+    {
+        unsigned int delayedBytes = file->delayedStart + file->delayedSize - position;
+        if(delayedBytes > nbytes - bytesRead) delayedBytes = nbytes - bytesRead;
+
+        memcpy(&buf[bytesRead], &file->delayedData[position - file->delayedStart], delayedBytes);
+        bytesRead += delayedBytes;
     }
 
     file->currentByte += bytesRead;
+    file->raNextByte = file->currentByte;
 
     return bytesRead;
 }
@@ -311,98 +436,128 @@ int myfsRead(int fd, char *buf, unsigned int nbytes)
 
 
 
-int myfsWrite(int fd, const char *buf, unsigned int nbytes)
+int myfsRead(int fd, char *buf, unsigned int nbytes)
+{
+    __lockFs();
+    int result = __myfsRead(fd, buf, nbytes);
+    __unlockFs();
+
+    return result;
+}
+
+
+
+
+int __myfsWrite(int fd, const char *buf, unsigned int nbytes)
 {
     if(fd <= 0 || fd > MAX_FDS) return -1;
     FileInfo* file = openFiles[fd-1];
     if(file == NULL) return -1;
 
-    unsigned int inumber = inodeGetNumber(file->inode); // Atualiza inode do arquivo na memoria
-    free(file->inode);
-    file->inode = inodeLoad(inumber, file->disk);
+    // Apenas um descritor de cada arquivo mantem dados pendentes de alocacao atrasada, ja que o fim do arquivo visto
+    // por esta escrita precisa incluir os dados dos demais
+    if(!__flushOtherDelayedData(file)) return -1;
 
-    unsigned int fileSize = inodeGetFileSize(file->inode);
-    unsigned int bytesWritten = 0;
-    unsigned int currentInodeBlockNum = file->currentByte / file->diskBlockSize;
-    unsigned int offset = file->currentByte % file->diskBlockSize; // offset em bytes a partir do início do bloco
-    unsigned int currentBlock = inodeGetBlockAddr(file->inode, currentInodeBlockNum);
-    unsigned char diskBuffer[DISK_SECTORDATASIZE];
+    // Uma escrita alem do fim do arquivo deixa um buraco entre o fim atual e o cursor
+    if(file->currentByte > __getFileSize(file))
+    {
+        if(inodeGetFileType(file->inode) != FILETYPE_REGULAR || !__extendFile(file, file->currentByte)) return -1;
+    }
 
+    if(inodeGetFileType(file->inode) != FILETYPE_REGULAR) return __writeBlocks(file, buf, nbytes);
+
+    // Arquivos comuns escrevem diretamente apenas nos blocos que ja possuem, o restante aguarda a alocacao atrasada
+    unsigned int bytesWritten = 0;
     while(bytesWritten < nbytes)
     {
-        unsigned int sectorsPerBlock = file->diskBlockSize / DISK_SECTORDATASIZE;
-        unsigned int firstSector = offset / DISK_SECTORDATASIZE;
-        unsigned int firstByteInSector = offset % DISK_SECTORDATASIZE;
+        unsigned int mappedBytes = __getNumFileBlocks(file->inode, file->diskBlockSize) * file->diskBlockSize;
+        int ret;
 
-        if(currentBlock == 0)
+        if(file->currentByte < mappedBytes)
         {
-            currentBlock = __findFreeBlock(file->disk);
+            unsigned int directBytes = nbytes - bytesWritten < mappedBytes - file->currentByte ?
+                                       nbytes - bytesWritten : mappedBytes - file->currentByte;
 
-            if(currentBlock == 0) break; // Disco cheio
-
-            if(inodeAddBlock(file->inode, currentBlock) == -1) // Erro na associacao do bloco livre ao inode
-            {
-                __setBlockFree(file->disk, currentBlock);
-                break;
-            }
+            ret = __writeBlocks(file, buf + bytesWritten, directBytes);
+            if(ret == 0) break; // Disco cheio
         }
-
-        int i;
-        for(i = firstSector; i < sectorsPerBlock && bytesWritten < nbytes; i++)
+        else if(file->delayedSize == 0 &&
+                __getBlockAddr(file->disk, file->inode, file->currentByte / file->diskBlockSize) != 0)
         {
-            if(diskReadSector(file->disk, currentBlock + i, diskBuffer) == -1) return -1;
+            // Blocos reservados por myfsFallocate alem do fim do arquivo sao usados diretamente
+            ret = __writeBlocks(file, buf + bytesWritten, nbytes - bytesWritten);
+            if(ret == 0) break;
+        }
+        else ret = __writeDelayed(file, buf + bytesWritten, nbytes - bytesWritten);
 
-            int j;
-            for(j = firstByteInSector; j < DISK_SECTORDATASIZE && bytesWritten < nbytes; j++)
-            {
-                diskBuffer[j] = buf[bytesWritten];
-                bytesWritten++;
-            }
+        if(ret == -1) return bytesWritten > 0 ? (int) bytesWritten : -1;
+        bytesWritten += ret;
+    }
 
-            if(diskWriteSector(file->disk, currentBlock + i, diskBuffer) == -1) return -1;
-            firstByteInSector = 0;
-        }
+    return bytesWritten;
+}
 
-        offset = 0;
-        currentInodeBlockNum++;
 
-        currentBlock = (file->currentByte + bytesWritten < fileSize) ?
-                        inodeGetBlockAddr(file->inode, currentInodeBlockNum) :
-                        0;
-    }
 
-    file->currentByte += bytesWritten;
-    if(file->currentByte >= fileSize)
-    {
-        inodeSetFileSize(file->inode, file->currentByte);
-        inodeSave(file->inode);
-    }
 
-    return bytesWritten;
+int myfsWrite(int fd, const char *buf, unsigned int nbytes)
+{
+    __lockFs();
+    int result = __myfsWrite(fd, buf, nbytes);
+    __unlockFs();
+
+    return result;
 }
 
 
 
 
-int myfsClose(int fd)
+int __myfsClose(int fd)
 {
-    if(fd <= 0 || fd > MAX_FDS) return -1;
+    if(fd <= 0 || fd > MAX_FDS || openFiles[fd-1] == NULL) return -1;
     FileInfo* file = openFiles[fd-1];
 
-    if(file == NULL) return -1;
+    bool flushed = __flushDelayedData(file);
+    if(!__flushBlockCache(file)) flushed = false;
+    if(!__saveChecksums(file->disk)) flushed = false;
 
-    // Libera apenas o ponteiro para o Inode pois o ponteiro para Disk ja existia antes da alocacao do FileInfo
-    free(file->inode);
+    // Devolve apenas o Inode pois o ponteiro para Disk ja existia antes da alocacao do FileInfo. O inode so e liberado
+    // quando nenhum outro descritor o estiver usando
+    __releaseInode(file->inode);
+    free(file->delayedData);
+    free(file->cacheData);
+    free(file->raData);
+    free(file->raBlocks);
+    free(file->extChain);
 
     free(file);
     openFiles[fd-1] = NULL;
-    return 0;
+
+    return flushed ? 0 : -1;
 }
 
 
 
 
-int myfsOpendir(Disk *d, const char *path)
+int myfsClose(int fd)
+{
+    if(fd <= 0 || fd > MAX_FDS) return -1;
+
+    // Operacoes assincronas do descritor usariam o FileInfo depois de liberado, entao terminam antes. A espera e feita
+    // sem fsLock, que as operacoes em execucao precisam obter
+    __waitAsyncRequests(fd);
+
+    __lockFs();
+    int result = __myfsClose(fd);
+    __unlockFs();
+
+    return result;
+}
+
+
+
+
+int __myfsOpendir(Disk *d, const char *path)
 {
     int currentDirFd = __openRoot(d);
     if(currentDirFd == -1) return -1;
@@ -427,21 +582,17 @@ int myfsOpendir(Disk *d, const char *path)
         {
             if(strcmp(entry.filename, nextDirname) == 0)
             {
-                Inode* nextDirInode = inodeLoad(entry.inumber, d);
+                Inode* nextDirInode = __acquireInode(d, entry.inumber);
                 if(nextDirInode == NULL || inodeGetFileType(nextDirInode) != FILETYPE_DIR)
                 {
-                    free(nextDirInode);
+                    __releaseInode(nextDirInode);
                     return -1;
                 }
 
                 foundEntry = true;
                 myfsClosedir(currentDirFd);
 
-                openFiles[currentDirFd-1] = malloc(sizeof(FileInfo));
-                openFiles[currentDirFd-1]->disk = d;
-                openFiles[currentDirFd-1]->diskBlockSize = blockSize;
-                openFiles[currentDirFd-1]->inode = nextDirInode;
-                openFiles[currentDirFd-1]->currentByte = 0;
+                openFiles[currentDirFd-1] = __newFileInfo(d, blockSize, nextDirInode);
 
                 break;
             }
@@ -451,14 +602,14 @@ int myfsOpendir(Disk *d, const char *path)
         // cria um novo diretorio vazio dentro do atual
         if(!foundEntry && path[0] == '\0')
         {
-            unsigned int newDirInumber = inodeFindFreeInode(ROOT_DIRECTORY_INODE + 1, d);
+            unsigned int newDirInumber = __findFreeInode(d, inodeGetNumber(openFiles[currentDirFd-1]->inode), true);
             if(newDirInumber == 0)
             {
                 myfsClosedir(currentDirFd);
                 return -1;
             }
 
-            Inode* newDirInode = inodeLoad(newDirInumber, d);
+            Inode* newDirInode = __acquireInode(d, newDirInumber);
             if(newDirInode == NULL)
             {
                 myfsClosedir(currentDirFd);
@@ -469,10 +620,11 @@ int myfsOpendir(Disk *d, const char *path)
             inodeSetRefCount(newDirInode, 0);
             inodeSetFileSize(newDirInode, 0);
 
-            unsigned int newDirFirstBlock = __findFreeBlock(d);
+            unsigned int allocated;
+            unsigned int newDirFirstBlock = __findFreeBlocks(d, __getGroupFirstBlock(d, newDirInumber), 1, &allocated);
             if(newDirFirstBlock == 0)
             {
-                free(newDirInode);
+                __releaseInode(newDirInode);
                 myfsClosedir(currentDirFd);
                 return -1;
             }
@@ -480,7 +632,7 @@ int myfsOpendir(Disk *d, const char *path)
             if( inodeAddBlock(newDirInode, newDirFirstBlock) == -1 ||
                 myfsLink(currentDirFd, nextDirname, newDirInumber) == -1 )
             {
-                free(newDirInode);
+                __releaseInode(newDirInode);
                 myfsClosedir(currentDirFd);
                 __setBlockFree(d, newDirFirstBlock);
                 return -1;
@@ -491,13 +643,11 @@ int myfsOpendir(Disk *d, const char *path)
             strcpy(parent.filename, "..");
 
             myfsClosedir(currentDirFd);
-            openFiles[currentDirFd-1] = malloc(sizeof(FileInfo));
-            openFiles[currentDirFd-1]->disk = d;
-            openFiles[currentDirFd-1]->diskBlockSize = blockSize;
-            openFiles[currentDirFd-1]->inode = newDirInode;
-            openFiles[currentDirFd-1]->currentByte = 0;
+            openFiles[currentDirFd-1] = __newFileInfo(d, blockSize, newDirInode);
+
+            bool linked = __autoLink(currentDirFd) && myfsLink(currentDirFd, parent.filename, parent.inumber) != -1;
 
-            if( !__autoLink(currentDirFd) || myfsLink(currentDirFd, parent.filename, parent.inumber) == -1 )
+            if(!linked)
             {
                 __deleteFile(d, newDirInode); // Nao usa __deleteDir pois o novo diretorio nao e um diretorio valido
                 myfsClosedir(currentDirFd);
@@ -521,7 +671,19 @@ int myfsOpendir(Disk *d, const char *path)
 
 
 
-int myfsReaddir(int fd, char *filename, unsigned int *inumber)
+int myfsOpendir(Disk *d, const char *path)
+{
+    __lockFs();
+    int result = __myfsOpendir(d, path);
+    __unlockFs();
+
+    return result;
+}
+
+
+
+
+int __myfsReaddir(int fd, char *filename, unsigned int *inumber)
 {
     if(fd <= 0 || fd > MAX_FDS) return -1;
     FileInfo* file = openFiles[fd-1];
@@ -542,30 +704,39 @@ int myfsReaddir(int fd, char *filename, unsigned int *inumber)
 
 
 
-int myfsLink(int fd, const char *filename, unsigned int inumber)
+int myfsReaddir(int fd, char *filename, unsigned int *inumber)
+{
+    __lockFs();
+    int result = __myfsReaddir(fd, filename, inumber);
+    __unlockFs();
+
+    return result;
+}
+
+
+
+
+int __myfsLink(int fd, const char *filename, unsigned int inumber)
 {
     if(fd <= 0 || fd > MAX_FDS) return -1;
     FileInfo* dir = openFiles[fd-1];
 
     if(dir == NULL || inodeGetFileType(dir->inode) != FILETYPE_DIR) return -1;
 
-    unsigned int dirInumber = inodeGetNumber(dir->inode); // Atualiza inode do diretorio na memoria
-    free(dir->inode);
-    dir->inode = inodeLoad(dirInumber, dir->disk);
-
-    Inode* inodeToLink = inodeLoad(inumber, dir->disk);
+    Inode* inodeToLink = __acquireInode(dir->disk, inumber);
     if(inodeToLink == NULL) return -1;
 
-    unsigned int previousCurrentByte = dir->currentByte;
     unsigned int previousDirSize = inodeGetFileSize(dir->inode);
-    dir->currentByte = 0; // Para percorrer as entradas desde o inicio
 
+    // Entradas sao lidas e escritas por posicao, sem alterar o cursor do diretorio
     DirectoryEntry entry;
-    while(myfsReaddir(fd, entry.filename, &entry.inumber) == 1)
+    unsigned int entryByte;
+    for(entryByte = 0; myfsPread(fd, (char*) &entry, sizeof(DirectoryEntry), entryByte) == sizeof(DirectoryEntry);
+        entryByte += sizeof(DirectoryEntry))
     {
         if(strcmp(entry.filename, filename) == 0) // Entrada ja existe
         {
-            free(inodeToLink);
+            __releaseInode(inodeToLink);
             return -1;
         }
     }
@@ -573,8 +744,7 @@ int myfsLink(int fd, const char *filename, unsigned int inumber)
     strcpy(entry.filename, filename);
     entry.inumber = inumber;
 
-    int bytesWritten = myfsWrite(fd, (const char*) &entry, sizeof(DirectoryEntry));
-    dir->currentByte = previousCurrentByte;
+    int bytesWritten = myfsPwrite(fd, (const char*) &entry, sizeof(DirectoryEntry), previousDirSize);
 
     if(bytesWritten != sizeof(DirectoryEntry)) // Falha na insercao de uma nova entrada
     {
@@ -582,7 +752,7 @@ int myfsLink(int fd, const char *filename, unsigned int inumber)
         inodeSetFileSize(dir->inode, previousDirSize);
         inodeSave(dir->inode);
 
-        free(inodeToLink);
+        __releaseInode(inodeToLink);
         return -1;
     }
 
@@ -590,39 +760,47 @@ int myfsLink(int fd, const char *filename, unsigned int inumber)
     inodeSetRefCount(inodeToLink, previousRefCount + 1);
 
     inodeSave(inodeToLink);
-    free(inodeToLink);
+    __releaseInode(inodeToLink);
     return 0;
 }
 
 
 
 
-int myfsUnlink(int fd, const char *filename)
+int myfsLink(int fd, const char *filename, unsigned int inumber)
+{
+    __lockFs();
+    int result = __myfsLink(fd, filename, inumber);
+    __unlockFs();
+
+    return result;
+}
+
+
+
+
+int __myfsUnlink(int fd, const char *filename)
 {
     if(fd <= 0 || fd > MAX_FDS) return -1;
     FileInfo* dir = openFiles[fd-1];
 
     if(dir == NULL || inodeGetFileType(dir->inode) != FILETYPE_DIR) return -1;
 
-    unsigned int dirInumber = inodeGetNumber(dir->inode); // Atualiza inode do diretorio na memoria
-    free(dir->inode);
-    dir->inode = inodeLoad(dirInumber, dir->disk);
-
     if(strcmp(filename, ".") == 0 || strcmp(filename, "..") == 0) return -1;
 
-    unsigned int previousCurrentByte = dir->currentByte;
-    dir->currentByte = 0; // Para percorrer as entradas de dir desde o inicio
-
+    // Entradas sao lidas e escritas por posicao, sem alterar o cursor do diretorio
     Inode* inodeToUnlink = NULL;
     unsigned int previousRefCount = 0;
     DirectoryEntry entry;
     unsigned int inumber = 0;
-    while(myfsRead(fd, (char*) &entry, sizeof(DirectoryEntry)) == sizeof(DirectoryEntry))
+    unsigned int entryByte;
+    for(entryByte = 0; myfsPread(fd, (char*) &entry, sizeof(DirectoryEntry), entryByte) == sizeof(DirectoryEntry);
+        entryByte += sizeof(DirectoryEntry))
     {
         if(strcmp(entry.filename, filename) == 0)
         {
             inumber = entry.inumber;
-            inodeToUnlink = inodeLoad(inumber, dir->disk);
+            inodeToUnlink = __acquireInode(dir->disk, inumber);
             if(inodeToUnlink == NULL) return -1;
 
             previousRefCount = inodeGetRefCount(inodeToUnlink);
@@ -637,7 +815,7 @@ int myfsUnlink(int fd, const char *filename)
                 {
                     if(openFiles[i-1] != NULL && inodeGetNumber(openFiles[i-1]->inode) == inumber)
                     {
-                        free(inodeToUnlink);
+                        __releaseInode(inodeToUnlink);
                         return -1;
                     }
                 }
@@ -646,7 +824,7 @@ int myfsUnlink(int fd, const char *filename)
             if( (inodeGetFileType(inodeToUnlink) == FILETYPE_DIR && previousRefCount == 2) &&
                  inodeGetFileSize(inodeToUnlink) != 2 * sizeof(DirectoryEntry) )
             {
-                free(inodeToUnlink); // Significa que o diretorio a ser deletado possui outras entradas alem de . e ..
+                __releaseInode(inodeToUnlink); // Significa que o diretorio a ser deletado possui outras entradas alem de . e ..
                 return -1;
             }
 
@@ -654,19 +832,12 @@ int myfsUnlink(int fd, const char *filename)
 
             // Para remover a entrada encontrada, percorre-se o diretorio lendo as entradas da frente e escrevendo sobre
             // as anteriores, "arrastando" as entradas para tras
-            unsigned int currentEntryByte = dir->currentByte - sizeof(DirectoryEntry);
-            unsigned int nextEntryByte = dir->currentByte;
-
-            dir->currentByte = nextEntryByte;
-            while(myfsRead(fd, (char*) &entry, sizeof(DirectoryEntry)) == sizeof(DirectoryEntry))
+            unsigned int nextEntryByte;
+            for(nextEntryByte = entryByte + sizeof(DirectoryEntry);
+                myfsPread(fd, (char*) &entry, sizeof(DirectoryEntry), nextEntryByte) == sizeof(DirectoryEntry);
+                nextEntryByte += sizeof(DirectoryEntry))
             {
-                dir->currentByte = currentEntryByte;
-                myfsWrite(fd, (char*) &entry, sizeof(DirectoryEntry));
-
-                currentEntryByte += sizeof(DirectoryEntry);
-                nextEntryByte += sizeof(DirectoryEntry);
-
-                dir->currentByte = nextEntryByte;
+                myfsPwrite(fd, (const char*) &entry, sizeof(DirectoryEntry), nextEntryByte - sizeof(DirectoryEntry));
             }
 
             unsigned int previousDirSize = inodeGetFileSize(dir->inode);
@@ -677,7 +848,6 @@ int myfsUnlink(int fd, const char *filename)
     }
 
     if(inumber == 0) return -1; // Entrada nao encontrada
-    dir->currentByte = previousCurrentByte;
 
     if(inodeGetFileType(inodeToUnlink) == FILETYPE_REGULAR && previousRefCount == 1)
         __deleteFile(dir->disk, inodeToUnlink);
@@ -686,14 +856,1117 @@ int myfsUnlink(int fd, const char *filename)
         __deleteDir(dir->disk, inodeToUnlink, dir->inode);
 
     inodeSave(inodeToUnlink);
-    free(inodeToUnlink);
+    __releaseInode(inodeToUnlink);
     return 0;
 }
 
 
 
 
+int myfsUnlink(int fd, const char *filename)
+{
+    __lockFs();
+    int result = __myfsUnlink(fd, filename);
+    __unlockFs();
+
+    return result;
+}
+
+
+
+
 int myfsClosedir(int fd)
 {
     return myfsClose(fd);
-}
\ No newline at end of file
+}
+
+
+
+
+int __myfsFlush(int fd)
+{
+    if(fd <= 0 || fd > MAX_FDS) return -1;
+    FileInfo* file = openFiles[fd-1];
+    if(file == NULL) return -1;
+
+    return __flushDelayedData(file) && __flushBlockCache(file) && __saveChecksums(file->disk) ? 0 : -1;
+}
+
+
+
+
+int myfsFlush(int fd)
+{
+    __lockFs();
+    int result = __myfsFlush(fd);
+    __unlockFs();
+
+    return result;
+}
+
+
+
+
+int __myfsFallocate(int fd, unsigned int length)
+{
+    if(fd <= 0 || fd > MAX_FDS) return -1;
+    FileInfo* file = openFiles[fd-1];
+
+    if(file == NULL || inodeGetFileType(file->inode) != FILETYPE_REGULAR) return -1;
+
+    // Dados pendentes precisam de blocos antes, para que os blocos reservados fiquem depois deles no mapa
+    if(!__flushDelayedData(file) || !__flushOtherDelayedData(file)) return -1;
+
+    unsigned int numBlocks;
+    unsigned int* blockMap = __loadBlockMap(file->disk, file->inode, &numBlocks);
+    if(blockMap == NULL) return -1;
+
+    // Os blocos reservados ficam logo apos o ultimo bloco de dados, ignorando buracos
+    unsigned int lastBlock = 0;
+    unsigned int i;
+    for(i = 0; i < numBlocks; i++)
+    {
+        if(blockMap[i] != HOLE_BLOCK) lastBlock = __getPhysicalBlock(file->disk, blockMap[i]);
+    }
+    free(blockMap);
+
+    unsigned int blocksWanted = (length + file->diskBlockSize - 1) / file->diskBlockSize;
+    if(blocksWanted <= numBlocks) return 0;
+
+    unsigned int blocksNeeded = blocksWanted - numBlocks;
+    unsigned int* blocks = malloc(blocksNeeded * sizeof(unsigned int));
+    if(blocks == NULL) return -1;
+
+    // Todos os blocos sao reservados de uma so vez, logo apos o ultimo bloco atual, e associados ao inode em lote. O
+    // tamanho do arquivo nao muda, os blocos passam a ser usados conforme o arquivo cresce
+    unsigned int sectorsPerBlock = file->diskBlockSize / DISK_SECTORDATASIZE;
+    unsigned int blocksReserved = __reserveBlocks(file->disk, lastBlock + sectorsPerBlock, blocksNeeded, blocks);
+    unsigned int blocksAppended = blocksReserved == blocksNeeded ?
+                                  __appendBlocks(file->disk, file->inode, blocks, blocksReserved) :
+                                  0;
+
+    __setBlockListFree(file->disk, blocks + blocksAppended, blocksReserved - blocksAppended);
+    free(blocks);
+
+    return blocksAppended == blocksNeeded ? 0 : -1;
+}
+
+
+
+
+int myfsFallocate(int fd, unsigned int length)
+{
+    __lockFs();
+    int result = __myfsFallocate(fd, length);
+    __unlockFs();
+
+    return result;
+}
+
+
+
+
+int __myfsSetAllocPolicy(Disk *d, int policy)
+{
+    if(policy != MYFS_ALLOC_FIRST_FIT && policy != MYFS_ALLOC_NEXT_FIT && policy != MYFS_ALLOC_BEST_FIT) return -1;
+
+    MountInfo* mount = __getMountInfo(d);
+    if(mount == NULL) return -1;
+
+    // As arvores de extensoes so sao mantidas enquanto alguma politica as usa
+    if(policy == MYFS_ALLOC_FIRST_FIT) __invalidateFreeExtents(mount);
+
+    mount->allocPolicy = policy;
+    return 0;
+}
+
+
+
+
+int myfsSetAllocPolicy(Disk *d, int policy)
+{
+    __lockFs();
+    int result = __myfsSetAllocPolicy(d, policy);
+    __unlockFs();
+
+    return result;
+}
+
+
+
+
+int __myfsSetCompression(Disk *d, int enabled)
+{
+    MountInfo* mount = __getMountInfo(d);
+    if(mount == NULL) return -1;
+
+    // Blocos comprimidos agrupados dependem da tabela de referencias, e seus setores precisam caber no endereco
+    if(enabled && (mount->refCountSector == 0 || diskGetNumSectors(d) > COMPRESSED_SECTOR_MASK)) return -1;
+
+    mount->compression = enabled != 0;
+    return 0;
+}
+
+
+
+
+int myfsSetCompression(Disk *d, int enabled)
+{
+    __lockFs();
+    int result = __myfsSetCompression(d, enabled);
+    __unlockFs();
+
+    return result;
+}
+
+
+
+
+int __myfsSetDedup(Disk *d, int enabled)
+{
+    MountInfo* mount = __getMountInfo(d);
+    if(mount == NULL) return -1;
+
+    if(!enabled)
+    {
+        free(mount->dedupIndex);
+        mount->dedupIndex = NULL;
+        return 0;
+    }
+
+    // Blocos deduplicados sao compartilhados por meio da tabela de referencias
+    if(mount->refCountSector == 0) return -1;
+
+    if(mount->dedupIndex == NULL) mount->dedupIndex = calloc(DEDUP_INDEX_SIZE, sizeof(DedupEntry));
+    return mount->dedupIndex != NULL ? 0 : -1;
+}
+
+
+
+
+int myfsSetDedup(Disk *d, int enabled)
+{
+    __lockFs();
+    int result = __myfsSetDedup(d, enabled);
+    __unlockFs();
+
+    return result;
+}
+
+
+
+
+int __myfsDefrag(Disk *d, unsigned int maxBlocksMoved, DefragReport *report)
+{
+    if(report == NULL) return -1;
+    memset(report, 0, sizeof(DefragReport));
+
+    unsigned int numInodes = __getNumInodes(d);
+    if(numInodes == 0) return -1;
+
+    // Entradas de diretorios abertos podem estar apenas no cache de bloco de seus descritores
+    int fd;
+    for(fd=0; fd < MAX_FDS; fd++)
+    {
+        if(openFiles[fd] != NULL && openFiles[fd]->disk == d && !__flushBlockCache(openFiles[fd])) return -1;
+    }
+
+    // Percorre a arvore de diretorios a partir da raiz, ja que inodes de extensao nao podem ser distinguidos de inodes
+    // de arquivos olhando apenas a area de inodes. Arquivos com mais de um nome sao processados uma unica vez
+    bool* visited = calloc(numInodes + 1, sizeof(bool));
+    unsigned int* pendingDirs = malloc((numInodes + 1) * sizeof(unsigned int));
+    if(visited == NULL || pendingDirs == NULL)
+    {
+        free(visited);
+        free(pendingDirs);
+        return -1;
+    }
+
+    unsigned int numPending = 0;
+    pendingDirs[numPending++] = ROOT_DIRECTORY_INODE;
+    visited[ROOT_DIRECTORY_INODE] = true;
+
+    // O limite de blocos movidos por passada controla quanto de E/S a desfragmentacao tira dos demais usuarios do disco
+    unsigned int budget = maxBlocksMoved;
+
+    while(numPending > 0)
+    {
+        unsigned int dirInumber = pendingDirs[--numPending];
+
+        Inode* dir = __acquireInode(d, dirInumber);
+        if(dir == NULL) continue;
+
+        unsigned int numEntries;
+        DirectoryEntry* entries = __loadDirEntries(d, dir, &numEntries);
+        __releaseInode(dir);
+        if(entries == NULL) continue;
+
+        unsigned int i;
+        for(i = 0; i < numEntries; i++)
+        {
+            unsigned int inumber = entries[i].inumber;
+            if(inumber == 0 || inumber > numInodes || visited[inumber]) continue;
+            visited[inumber] = true;
+
+            Inode* inode = __acquireInode(d, inumber);
+            if(inode == NULL) continue;
+
+            bool isDir = inodeGetFileType(inode) == FILETYPE_DIR;
+            __releaseInode(inode);
+
+            // Arquivos abertos tem inode e dados pendentes em memoria, entao seus blocos nao sao movidos
+            if(isDir) pendingDirs[numPending++] = inumber;
+            else if(!__isInodeOpen(d, inumber)) budget -= __defragFile(d, inumber, budget, report);
+        }
+
+        free(entries);
+
+        if(!__isInodeOpen(d, dirInumber)) budget -= __defragFile(d, dirInumber, budget, report);
+    }
+
+    free(visited);
+    free(pendingDirs);
+
+    // Os blocos movidos nao pertencem a nenhum descritor, entao seus checksums sao gravados aqui
+    return __saveChecksums(d) ? 0 : -1;
+}
+
+
+
+
+int myfsDefrag(Disk *d, unsigned int maxBlocksMoved, DefragReport *report)
+{
+    __lockFs();
+    int result = __myfsDefrag(d, maxBlocksMoved, report);
+    __unlockFs();
+
+    return result;
+}
+
+
+
+
+int __myfsSeek(int fd, int offset, int whence)
+{
+    if(fd <= 0 || fd > MAX_FDS) return -1;
+    FileInfo* file = openFiles[fd-1];
+    if(file == NULL) return -1;
+
+    long base;
+    if(whence == MYFS_SEEK_SET) base = 0;
+    else if(whence == MYFS_SEEK_CUR) base = file->currentByte;
+    else if(whence == MYFS_SEEK_END)
+    {
+        // O fim do arquivo inclui os dados pendentes dos outros descritores do mesmo arquivo
+        if(!__flushOtherDelayedData(file)) return -1;
+        base = __getFileSize(file);
+    }
+    else return -1;
+
+    // O cursor pode passar do fim do arquivo; uma escrita nessa posicao torna o arquivo esparso
+    long position = base + offset;
+    if(position < 0 || position > INT_MAX) return -1;
+
+    file->currentByte = position;
+    return position;
+}
+
+
+
+
+int myfsSeek(int fd, int offset, int whence)
+{
+    __lockFs();
+    int result = __myfsSeek(fd, offset, whence);
+    __unlockFs();
+
+    return result;
+}
+
+
+
+
+int __myfsPread(int fd, char *buf, unsigned int nbytes, unsigned int offset)
+{
+    if(fd <= 0 || fd > MAX_FDS) return -1;
+    FileInfo* file = openFiles[fd-1];
+    if(file == NULL) return -1;
+
+    // Le a partir de offset e devolve o cursor a posicao original. A leitura posicional tambem nao conta para a janela
+    // de leitura antecipada das leituras sequenciais pelo cursor
+    unsigned int previousCurrentByte = file->currentByte;
+    unsigned int previousNextByte = file->raNextByte;
+    unsigned int previousWindow = file->raWindow;
+    file->currentByte = offset;
+
+    int bytesRead = myfsRead(fd, buf, nbytes);
+    file->currentByte = previousCurrentByte;
+    file->raNextByte = previousNextByte;
+    file->raWindow = previousWindow;
+
+    return bytesRead;
+}
+
+
+
+
+int myfsPread(int fd, char *buf, unsigned int nbytes, unsigned int offset)
+{
+    __lockFs();
+    int result = __myfsPread(fd, buf, nbytes, offset);
+    __unlockFs();
+
+    return result;
+}
+
+
+
+
+int __myfsPwrite(int fd, const char *buf, unsigned int nbytes, unsigned int offset)
+{
+    if(fd <= 0 || fd > MAX_FDS) return -1;
+    FileInfo* file = openFiles[fd-1];
+    if(file == NULL) return -1;
+
+    // Escreve a partir de offset e devolve o cursor a posicao original
+    unsigned int previousCurrentByte = file->currentByte;
+    file->currentByte = offset;
+
+    int bytesWritten = myfsWrite(fd, buf, nbytes);
+    file->currentByte = previousCurrentByte;
+
+    return bytesWritten;
+}
+
+
+
+
+int myfsPwrite(int fd, const char *buf, unsigned int nbytes, unsigned int offset)
+{
+    __lockFs();
+    int result = __myfsPwrite(fd, buf, nbytes, offset);
+    __unlockFs();
+
+    return result;
+}
+
+
+
+
+int __myfsReadv(int fd, const struct iovec *iov, int iovcnt)
+{
+    if(fd <= 0 || fd > MAX_FDS || openFiles[fd-1] == NULL) return -1;
+
+    long total = __getIovecLength(iov, iovcnt);
+    if(total == -1) return -1;
+    if(iovcnt == 1) return myfsRead(fd, iov[0].iov_base, iov[0].iov_len);
+
+    // Trechos pequenos sao lidos juntos, ate IOVEC_CHUNK bytes por chamada, e depois distribuidos entre eles, de modo
+    // que um setor compartilhado por varios trechos seja lido uma so vez. O restante de um trecho com ao menos
+    // IOVEC_CHUNK bytes e lido diretamente nele, sem copia
+    char* chunk = NULL;
+    unsigned int bytesRead = 0;
+    unsigned int segmentByte = 0;
+    bool failed = false;
+    bool ended = false;
+    int i = 0;
+    while(i < iovcnt && !failed && !ended)
+    {
+        char* segment = iov[i].iov_base;
+        unsigned int remaining = iov[i].iov_len - segmentByte;
+        if(remaining == 0)
+        {
+            i++;
+            segmentByte = 0;
+            continue;
+        }
+
+        if(remaining >= IOVEC_CHUNK)
+        {
+            int ret = myfsRead(fd, &segment[segmentByte], remaining);
+            if(ret > 0) bytesRead += ret;
+            failed = ret == -1;
+            ended = ret != (int) remaining;
+            segmentByte += remaining;
+            continue;
+        }
+
+        if(chunk == NULL) chunk = malloc(total < IOVEC_CHUNK ? total : IOVEC_CHUNK);
+        if(chunk == NULL)
+        {
+            failed = true;
+            break;
+        }
+
+        unsigned int wanted = total - bytesRead < IOVEC_CHUNK ? total - bytesRead : IOVEC_CHUNK;
+        int ret = myfsRead(fd, chunk, wanted);
+        failed = ret == -1;
+        ended = ret != (int) wanted;
+
+        unsigned int copied = 0;
+        while(ret > 0 && copied < (unsigned int) ret)
+        {
+            unsigned int length = iov[i].iov_len - segmentByte;
+            if(length > ret - copied) length = ret - copied;
+
+            memcpy(&((char*) iov[i].iov_base)[segmentByte], &chunk[copied], length);
+            copied += length;
+            segmentByte += length;
+            if(segmentByte == iov[i].iov_len)
+            {
+                i++;
+                segmentByte = 0;
+            }
+        }
+
+        bytesRead += copied;
+    }
+
+    free(chunk);
+    return failed && bytesRead == 0 ? -1 : (int) bytesRead;
+}
+
+
+
+
+int myfsReadv(int fd, const struct iovec *iov, int iovcnt)
+{
+    __lockFs();
+    int result = __myfsReadv(fd, iov, iovcnt);
+    __unlockFs();
+
+    return result;
+}
+
+
+
+
+int __myfsWritev(int fd, const struct iovec *iov, int iovcnt)
+{
+    if(fd <= 0 || fd > MAX_FDS || openFiles[fd-1] == NULL) return -1;
+
+    long total = __getIovecLength(iov, iovcnt);
+    if(total == -1) return -1;
+    if(iovcnt == 1) return myfsWrite(fd, iov[0].iov_base, iov[0].iov_len);
+
+    // Trechos pequenos sao reunidos, ate IOVEC_CHUNK bytes, e escritos com uma unica chamada, de modo que um cabecalho
+    // e seus dados no mesmo setor custem uma so gravacao. O restante de um trecho com ao menos IOVEC_CHUNK bytes, com
+    // nada reunido antes dele, e escrito diretamente dele, sem copia
+    char* chunk = NULL;
+    unsigned int chunkUsed = 0;
+    unsigned int bytesWritten = 0;
+    bool failed = false;
+    bool ended = false;
+    int i;
+    for(i=0; i < iovcnt && !failed && !ended; i++)
+    {
+        const char* segment = iov[i].iov_base;
+        unsigned int segmentByte = 0;
+        while(segmentByte < iov[i].iov_len && !failed && !ended)
+        {
+            const char* data = &segment[segmentByte];
+            unsigned int length = iov[i].iov_len - segmentByte;
+
+            if(chunkUsed > 0 || length < IOVEC_CHUNK)
+            {
+                if(chunk == NULL) chunk = malloc(total < IOVEC_CHUNK ? total : IOVEC_CHUNK);
+                if(chunk == NULL)
+                {
+                    failed = true;
+                    break;
+                }
+
+                if(length > IOVEC_CHUNK - chunkUsed) length = IOVEC_CHUNK - chunkUsed;
+                memcpy(&chunk[chunkUsed], data, length);
+                chunkUsed += length;
+                segmentByte += length;
+                if(chunkUsed < IOVEC_CHUNK) continue;
+
+                data = chunk;
+                length = chunkUsed;
+                chunkUsed = 0;
+            }
+            else segmentByte += length;
+
+            int ret = myfsWrite(fd, data, length);
+            if(ret > 0) bytesWritten += ret;
+            failed = ret == -1;
+            ended = ret != (int) length;
+        }
+    }
+
+    if(!failed && !ended && chunkUsed > 0)
+    {
+        int ret = myfsWrite(fd, chunk, chunkUsed);
+        if(ret > 0) bytesWritten += ret;
+        failed = ret == -1;
+    }
+
+    free(chunk);
+    return failed && bytesWritten == 0 ? -1 : (int) bytesWritten;
+}
+
+
+
+
+int myfsWritev(int fd, const struct iovec *iov, int iovcnt)
+{
+    __lockFs();
+    int result = __myfsWritev(fd, iov, iovcnt);
+    __unlockFs();
+
+    return result;
+}
+
+
+
+
+int __myfsTruncate(int fd, unsigned int newSize)
+{
+    if(fd <= 0 || fd > MAX_FDS) return -1;
+    FileInfo* file = openFiles[fd-1];
+
+    if(file == NULL || inodeGetFileType(file->inode) != FILETYPE_REGULAR) return -1;
+
+    // Os dados pendentes dos demais descritores do arquivo fazem parte do tamanho comparado com newSize
+    if(!__flushOtherDelayedData(file)) return -1;
+
+    // Aumentar o arquivo equivale a escrever alem do fim: o trecho acrescentado le como zeros
+    if(newSize >= __getFileSize(file)) return __extendFile(file, newSize) ? 0 : -1;
+
+    // Os demais descritores do arquivo esvaziam o cache, ja que seus blocos podem ser liberados
+    __dropReadAhead(file);
+
+    unsigned int inumber = inodeGetNumber(file->inode);
+    int i;
+    for(i=0; i < MAX_FDS; i++)
+    {
+        FileInfo* other = openFiles[i];
+        if(other == NULL || other->disk != file->disk || inodeGetNumber(other->inode) != inumber) continue;
+
+        if(!__flushBlockCache(other)) return -1;
+        other->cacheBlock = 0;
+    }
+
+    // Dados pendentes alem do novo tamanho sao descartados sem chegar ao disco
+    if(file->delayedSize > 0 && newSize > file->delayedStart)
+    {
+        file->delayedSize = newSize - file->delayedStart;
+        return 0;
+    }
+
+    file->delayedSize = 0;
+
+    unsigned int keepBlocks = (newSize + file->diskBlockSize - 1) / file->diskBlockSize;
+    if(!__truncateBlockMap(file->disk, file->inode, keepBlocks)) return -1;
+
+    inodeSetFileSize(file->inode, newSize);
+    inodeSave(file->inode);
+    return 0;
+}
+
+
+
+
+int myfsTruncate(int fd, unsigned int newSize)
+{
+    __lockFs();
+    int result = __myfsTruncate(fd, newSize);
+    __unlockFs();
+
+    return result;
+}
+
+
+
+
+int __myfsClone(int fd, int sourceFd)
+{
+    if(fd <= 0 || fd > MAX_FDS || sourceFd <= 0 || sourceFd > MAX_FDS) return -1;
+    FileInfo* file = openFiles[fd-1];
+    FileInfo* source = openFiles[sourceFd-1];
+
+    if(file == NULL || source == NULL || file->disk != source->disk ||
+       inodeGetFileType(file->inode) != FILETYPE_REGULAR || inodeGetFileType(source->inode) != FILETYPE_REGULAR)
+        return -1;
+
+    unsigned int inumber = inodeGetNumber(file->inode);
+    unsigned int sourceInumber = inodeGetNumber(source->inode);
+
+    MountInfo* mount = __getMountInfo(file->disk);
+    if(inumber == sourceInumber || mount == NULL || mount->refCountSector == 0) return -1;
+
+    // Os descritores da origem gravam seus dados pendentes e caches, ja que os blocos passam a ser compartilhados
+    int i;
+    for(i=0; i < MAX_FDS; i++)
+    {
+        FileInfo* other = openFiles[i];
+        if(other == NULL || other->disk != file->disk || inodeGetNumber(other->inode) != sourceInumber) continue;
+
+        if(!__flushDelayedData(other) || !__flushBlockCache(other)) return -1;
+    }
+
+    unsigned int fileSize = inodeGetFileSize(source->inode);
+    unsigned int numBlocks;
+    unsigned int* blocks = __loadBlockMap(file->disk, source->inode, &numBlocks);
+    if(blocks == NULL) return -1;
+
+    // Blocos reservados por myfsFallocate alem do fim da origem nao fazem parte do clone
+    unsigned int cloneBlocks = (fileSize + file->diskBlockSize - 1) / file->diskBlockSize;
+    if(cloneBlocks == 0) cloneBlocks = 1;
+    if(cloneBlocks > numBlocks) cloneBlocks = numBlocks;
+
+    // Os enderecos do inode principal so sao alterados pelo inode em memoria e nao podem passar por copia na escrita,
+    // entao esses blocos sao copiados, o primeiro para o bloco que o destino ja possui. O conteudo atual do destino so
+    // e descartado depois de reservadas e preenchidas as demais copias e acrescentadas as referencias, de modo que uma
+    // falha nessas etapas o deixe intacto
+    unsigned int baseBlocks = cloneBlocks < INODE_NUM_BLOCKS ? cloneBlocks : INODE_NUM_BLOCKS;
+    unsigned int copies[INODE_NUM_BLOCKS];
+    copies[0] = inodeGetBlockAddr(file->inode, 0);
+
+    unsigned int sectorsPerBlock = file->diskBlockSize / DISK_SECTORDATASIZE;
+    unsigned int reserved = __reserveBlocks(file->disk, copies[0] + sectorsPerBlock, baseBlocks - 1, &copies[1]);
+
+    bool success = reserved == baseBlocks - 1;
+
+    unsigned int copiedBytes = baseBlocks * file->diskBlockSize;
+    if(copiedBytes > fileSize) copiedBytes = fileSize;
+    unsigned char sector[DISK_SECTORDATASIZE];
+
+    unsigned int s;
+    for(s = sectorsPerBlock; success && s * DISK_SECTORDATASIZE < copiedBytes; s++)
+    {
+        success = __readBlockSector(file->disk, blocks[s / sectorsPerBlock] + s % sectorsPerBlock, sector) != -1 &&
+                  __writeBlockSector(file->disk, copies[s / sectorsPerBlock] + s % sectorsPerBlock, sector) != -1;
+    }
+
+    // Os blocos das extensoes, a maior parte de um arquivo grande, sao apenas compartilhados
+    unsigned int numShared = cloneBlocks - baseBlocks;
+    unsigned int* shared = malloc((numShared + 1) * sizeof(unsigned int));
+
+    if(success && shared != NULL)
+    {
+        memcpy(shared, &blocks[baseBlocks], numShared * sizeof(unsigned int));
+        success = __addBlockRefs(file->disk, shared, numShared);
+    }
+    else success = false;
+
+    free(shared);
+
+    if(!success)
+    {
+        __setBlockListFree(file->disk, &copies[1], reserved);
+        free(blocks);
+        return -1;
+    }
+
+    // Os descritores do destino descartam o conteudo atual do arquivo, que passa a ter apenas o primeiro bloco
+    __dropReadAhead(file);
+
+    for(i=0; i < MAX_FDS; i++)
+    {
+        FileInfo* other = openFiles[i];
+        if(other == NULL || other->disk != file->disk || inodeGetNumber(other->inode) != inumber) continue;
+
+        other->delayedSize = 0;
+        other->cacheBlock = other->cacheDirtyStart = other->cacheDirtyEnd = 0;
+    }
+
+    success = __truncateBlockMap(file->disk, file->inode, 1);
+    inodeSetFileSize(file->inode, 0);
+    inodeSave(file->inode);
+
+    for(s = 0; success && s < sectorsPerBlock && s * DISK_SECTORDATASIZE < copiedBytes; s++)
+    {
+        success = __readBlockSector(file->disk, blocks[0] + s, sector) != -1 &&
+                  __writeBlockSector(file->disk, copies[0] + s, sector) != -1;
+    }
+
+    memcpy(blocks, copies, baseBlocks * sizeof(unsigned int));
+
+    unsigned int appended = success ? __appendBlocks(file->disk, file->inode, &blocks[1], cloneBlocks - 1) : 0;
+    if(!success || appended != cloneBlocks - 1)
+    {
+        // Os blocos que nao entraram no mapa perdem a referencia acrescentada, e o destino volta a ficar vazio
+        __setBlockListFree(file->disk, &blocks[1 + appended], cloneBlocks - 1 - appended);
+        __truncateBlockMap(file->disk, file->inode, 1);
+        free(blocks);
+        return -1;
+    }
+
+    free(blocks);
+
+    inodeSetFileSize(file->inode, fileSize);
+    inodeSave(file->inode);
+    return 0;
+}
+
+
+
+
+int myfsClone(int fd, int sourceFd)
+{
+    __lockFs();
+    int result = __myfsClone(fd, sourceFd);
+    __unlockFs();
+
+    return result;
+}
+
+
+
+
+int __myfsCopyRange(int sourceFd, unsigned int sourceOffset, int fd, unsigned int offset, unsigned int length)
+{
+    if(fd <= 0 || fd > MAX_FDS || sourceFd <= 0 || sourceFd > MAX_FDS) return -1;
+    FileInfo* file = openFiles[fd-1];
+    FileInfo* source = openFiles[sourceFd-1];
+
+    if(file == NULL || source == NULL ||
+       inodeGetFileType(file->inode) != FILETYPE_REGULAR || inodeGetFileType(source->inode) != FILETYPE_REGULAR)
+        return -1;
+
+    unsigned int inumber = inodeGetNumber(file->inode);
+    unsigned int sourceInumber = inodeGetNumber(source->inode);
+
+    // Os blocos da origem sao lidos diretamente, entao seus dados pendentes precisam estar em disco. Os do destino sao
+    // gravados antes para que os blocos reservados pela copia fiquem depois deles
+    int i;
+    for(i=0; i < MAX_FDS; i++)
+    {
+        FileInfo* other = openFiles[i];
+        if(other == NULL) continue;
+
+        if( ((other->disk == source->disk && inodeGetNumber(other->inode) == sourceInumber) ||
+             (other->disk == file->disk && inodeGetNumber(other->inode) == inumber)) && !__flushDelayedData(other) )
+            return -1;
+    }
+
+    unsigned int sourceSize = inodeGetFileSize(source->inode);
+    if(sourceOffset >= sourceSize) return 0;
+
+    if(length > sourceSize - sourceOffset) length = sourceSize - sourceOffset;
+    if(length > UINT_MAX - offset) length = UINT_MAX - offset;
+    if(length > INT_MAX) length = INT_MAX;
+    if(length == 0) return 0;
+
+    // Trechos sobrepostos do mesmo arquivo nao sao aceitos, ja que a origem seria alterada durante a copia
+    if(file->disk == source->disk && inumber == sourceInumber &&
+       offset < sourceOffset + length && sourceOffset < offset + length) return -1;
+
+    // Um destino alem do fim do arquivo deixa um buraco, e os blocos que faltam para todo o trecho sao reservados de
+    // uma so vez, em sequencia. Se nao houver espaco para todos, a escrita aloca o que couber
+    if(offset > __getFileSize(file) && !__extendFile(file, offset)) return -1;
+    myfsFallocate(fd, offset + length);
+
+    unsigned int numBlocks;
+    unsigned int* blocks = __loadBlockMap(source->disk, source->inode, &numBlocks);
+    unsigned char* data = malloc(COPY_RANGE_CHUNK + DISK_SECTORDATASIZE);
+
+    if(blocks == NULL || data == NULL)
+    {
+        free(blocks);
+        free(data);
+        return -1;
+    }
+
+    // Os setores da origem sao lidos em trechos de ate COPY_RANGE_CHUNK bytes, gravados no destino a partir do mesmo
+    // buffer. Setores inteiros do destino vao direto ao disco, sem passar pelo cache
+    unsigned int previousCurrentByte = file->currentByte;
+    unsigned int copied = 0;
+    bool ioError = false;
+
+    while(copied < length)
+    {
+        unsigned int position = sourceOffset + copied;
+        unsigned int skipped = position % DISK_SECTORDATASIZE;
+
+        unsigned int chunk = length - copied;
+        if(chunk > COPY_RANGE_CHUNK) chunk = COPY_RANGE_CHUNK;
+
+        unsigned int numSectors = (skipped + chunk + DISK_SECTORDATASIZE - 1) / DISK_SECTORDATASIZE;
+        if(!__readFileSectors(source, blocks, numBlocks, position / DISK_SECTORDATASIZE, numSectors, data))
+        {
+            ioError = true;
+            break;
+        }
+
+        file->currentByte = offset + copied;
+        int written = __writeBlocks(file, (const char*) &data[skipped], chunk);
+        if(written == -1)
+        {
+            ioError = true;
+            break;
+        }
+
+        copied += written;
+        if((unsigned int) written < chunk) break; // Disco cheio
+    }
+
+    file->currentByte = previousCurrentByte;
+
+    free(blocks);
+    free(data);
+
+    return ioError && copied == 0 ? -1 : (int) copied;
+}
+
+
+
+
+int myfsCopyRange(int sourceFd, unsigned int sourceOffset, int fd, unsigned int offset, unsigned int length)
+{
+    __lockFs();
+    int result = __myfsCopyRange(sourceFd, sourceOffset, fd, offset, length);
+    __unlockFs();
+
+    return result;
+}
+
+
+
+
+FileMapping* __myfsMmap(int fd, unsigned int memoryBudget)
+{
+    if(fd <= 0 || fd > MAX_FDS) return NULL;
+    FileInfo* file = openFiles[fd-1];
+
+    if(file == NULL || inodeGetFileType(file->inode) != FILETYPE_REGULAR) return NULL;
+
+    // As paginas sao lidas direto dos blocos do arquivo, entao dados pendentes precisam ser gravados antes, inclusive
+    // os de outros descritores do mesmo arquivo
+    if(!__flushOtherDelayedData(file) || myfsFlush(fd) == -1) return NULL;
+
+    FileMapping* map = calloc(1, sizeof(FileMapping));
+    if(map == NULL) return NULL;
+
+    map->fd = fd;
+    map->generation = file->generation;
+    map->length = inodeGetFileSize(file->inode);
+    map->pageSize = file->diskBlockSize;
+    map->numPages = (map->length + map->pageSize - 1) / map->pageSize;
+
+    // Pelo menos uma pagina fica em memoria, e nunca mais paginas do que o arquivo possui
+    map->maxResidentPages = memoryBudget / map->pageSize;
+    if(map->maxResidentPages == 0) map->maxResidentPages = 1;
+    if(map->maxResidentPages > map->numPages) map->maxResidentPages = map->numPages;
+
+    // A posicao numPages de pages e referenced representa uma posicao de memoria sem pagina
+    unsigned int numBlocks;
+    map->blocks = __loadBlockMap(file->disk, file->inode, &numBlocks);
+    map->memory = malloc(map->maxResidentPages * map->pageSize + 1);
+    map->pages = calloc(map->numPages + 1, sizeof(unsigned char*));
+    map->referenced = calloc(map->numPages + 1, sizeof(unsigned char));
+    map->slotPage = malloc((map->maxResidentPages + 1) * sizeof(unsigned int));
+
+    if(map->blocks == NULL || numBlocks < map->numPages || map->memory == NULL || map->pages == NULL ||
+       map->referenced == NULL || map->slotPage == NULL)
+    {
+        myfsMunmap(map);
+        return NULL;
+    }
+
+    return map;
+}
+
+
+
+
+FileMapping* myfsMmap(int fd, unsigned int memoryBudget)
+{
+    __lockFs();
+    FileMapping* result = __myfsMmap(fd, memoryBudget);
+    __unlockFs();
+
+    return result;
+}
+
+
+
+
+const char* __myfsMapFault(FileMapping *map, unsigned int offset, unsigned int *length)
+{
+    if(map == NULL || offset >= map->length) return NULL;
+
+    // O mapeamento deixa de ser valido quando o descritor e fechado, ja que outro arquivo pode ocupar a mesma posicao,
+    // e quando o arquivo muda, ja que as paginas carregadas e o mapa de blocos guardado nao o refletem mais
+    FileInfo* file = openFiles[map->fd-1];
+    if(file == NULL || file->generation != map->generation) return NULL;
+
+    unsigned int page = offset / map->pageSize;
+    if(map->pages[page] == NULL)
+    {
+        unsigned int slot;
+        if(map->usedSlots < map->maxResidentPages) slot = map->usedSlots++;
+        else
+        {
+            // Algoritmo do relogio: paginas acessadas desde a ultima passagem ganham outra chance
+            while(map->referenced[map->slotPage[map->clockHand]])
+            {
+                map->referenced[map->slotPage[map->clockHand]] = 0;
+                map->clockHand = (map->clockHand + 1) % map->maxResidentPages;
+            }
+
+            slot = map->clockHand;
+            map->pages[map->slotPage[slot]] = NULL;
+            map->clockHand = (slot + 1) % map->maxResidentPages;
+        }
+
+        unsigned char* data = &map->memory[slot * map->pageSize];
+        if(!__readMappedPage(map, page, data))
+        {
+            map->slotPage[slot] = map->numPages;
+            return NULL;
+        }
+
+        map->slotPage[slot] = page;
+        map->pages[page] = data;
+    }
+
+    map->referenced[page] = 1;
+
+    unsigned int pageOffset = offset % map->pageSize;
+    if(length != NULL)
+    {
+        *length = map->pageSize - pageOffset;
+        if(*length > map->length - offset) *length = map->length - offset;
+    }
+
+    return (const char*) &map->pages[page][pageOffset];
+}
+
+
+
+
+const char* myfsMapFault(FileMapping *map, unsigned int offset, unsigned int *length)
+{
+    __lockFs();
+    const char* result = __myfsMapFault(map, offset, length);
+    __unlockFs();
+
+    return result;
+}
+
+
+
+
+int __myfsMunmap(FileMapping *map)
+{
+    if(map == NULL) return -1;
+
+    free(map->blocks);
+    free(map->memory);
+    free(map->pages);
+    free(map->referenced);
+    free(map->slotPage);
+
+    free(map);
+    return 0;
+}
+
+
+
+
+int myfsMunmap(FileMapping *map)
+{
+    __lockFs();
+    int result = __myfsMunmap(map);
+    __unlockFs();
+
+    return result;
+}
+
+
+
+
+int __myfsReadAsync(int fd, char *buf, unsigned int nbytes, unsigned int offset, AsyncCallback callback, void *arg)
+{
+    // O descritor e conferido por __submitAsync, com a fila travada
+    if(fd <= 0 || fd > MAX_FDS) return -1;
+
+    AsyncRequest* request = malloc(sizeof(AsyncRequest));
+    if(request == NULL) return -1;
+
+    request->fd = fd;
+    request->write = false;
+    request->buf = buf;
+    request->nbytes = nbytes;
+    request->offset = offset;
+    request->callback = callback;
+    request->arg = arg;
+
+    if(!__submitAsync(request))
+    {
+        free(request);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+
+
+int myfsReadAsync(int fd, char *buf, unsigned int nbytes, unsigned int offset, AsyncCallback callback, void *arg)
+{
+    __lockFs();
+    int result = __myfsReadAsync(fd, buf, nbytes, offset, callback, arg);
+    __unlockFs();
+
+    return result;
+}
+
+
+
+
+int __myfsWriteAsync(int fd, const char *buf, unsigned int nbytes, unsigned int offset, AsyncCallback callback,
+                     void *arg)
+{
+    // O descritor e conferido por __submitAsync, com a fila travada
+    if(fd <= 0 || fd > MAX_FDS) return -1;
+
+    AsyncRequest* request = malloc(sizeof(AsyncRequest));
+    if(request == NULL) return -1;
+
+    // O buffer so e lido pela escrita, feita por myfsPwrite
+    request->fd = fd;
+    request->write = true;
+    request->buf = (char*) buf;
+    request->nbytes = nbytes;
+    request->offset = offset;
+    request->callback = callback;
+    request->arg = arg;
+
+    if(!__submitAsync(request))
+    {
+        free(request);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+
+
+int myfsWriteAsync(int fd, const char *buf, unsigned int nbytes, unsigned int offset, AsyncCallback callback,
+                   void *arg)
+{
+    __lockFs();
+    int result = __myfsWriteAsync(fd, buf, nbytes, offset, callback, arg);
+    __unlockFs();
+
+    return result;
+}
+
+
+
+
+int myfsAsyncWait(void)
+{
+    pthread_mutex_lock(&asyncPool.lock);
+    while(asyncPool.pending > 0) pthread_cond_wait(&asyncPool.allDone, &asyncPool.lock);
+    pthread_mutex_unlock(&asyncPool.lock);
+
+    return 0;
+}
@@ -15,6 +15,7 @@
 #ifndef SO_TRABALHO2_MYFS_H
 #define SO_TRABALHO2_MYFS_H
 
+#include <sys/uio.h>
 #include "disk.h"
 #include "inode.h"
 #include "vfs.h"
@@ -32,6 +33,32 @@ int myfsReaddir(int fd, char *filename, unsigned int *inumber);
 int myfsLink(int fd, const char *filename, unsigned int inumber);
 int myfsUnlink(int fd, const char *filename);
 int myfsClosedir(int fd);
+int myfsFlush(int fd);
+int myfsFallocate(int fd, unsigned int length);
+int myfsSetAllocPolicy(Disk *d, int policy);
+
+// Politicas de alocacao de blocos aceitas por myfsSetAllocPolicy. FIRST_FIT percorre o mapa de bits a partir do bloco
+// objetivo; NEXT_FIT e BEST_FIT usam arvores de extensoes livres mantidas em memoria
+#define MYFS_ALLOC_FIRST_FIT 0
+#define MYFS_ALLOC_NEXT_FIT  1
+#define MYFS_ALLOC_BEST_FIT  2
+
+int myfsSetCompression(Disk *d, int enabled);
+int myfsSetDedup(Disk *d, int enabled);
+
+int myfsSeek(int fd, int offset, int whence);
+int myfsPread(int fd, char *buf, unsigned int nbytes, unsigned int offset);
+int myfsPwrite(int fd, const char *buf, unsigned int nbytes, unsigned int offset);
+int myfsReadv(int fd, const struct iovec *iov, int iovcnt);
+int myfsWritev(int fd, const struct iovec *iov, int iovcnt);
+int myfsTruncate(int fd, unsigned int newSize);
+int myfsClone(int fd, int sourceFd);
+int myfsCopyRange(int sourceFd, unsigned int sourceOffset, int fd, unsigned int offset, unsigned int length);
+
+// Referencias aceitas por myfsSeek para o deslocamento: inicio do arquivo, posicao atual e fim do arquivo
+#define MYFS_SEEK_SET 0
+#define MYFS_SEEK_CUR 1
+#define MYFS_SEEK_END 2
 
 
 typedef struct
@@ -40,6 +67,41 @@ typedef struct
     unsigned int diskBlockSize;
     Inode* inode;
     unsigned int currentByte;
+
+    // Alocacao atrasada: dados escritos alem do ultimo bloco de um arquivo comum ficam em memoria ate myfsFlush ou
+    // myfsClose, quando todos os blocos necessarios sao alocados de uma so vez
+    char* delayedData;
+    unsigned int delayedStart;    // Posicao no arquivo do primeiro byte de delayedData, sempre no inicio de um bloco
+    unsigned int delayedSize;     // Numero de bytes validos em delayedData
+    unsigned int delayedCapacity; // Numero de bytes alocados para delayedData
+
+    // Cache de um bloco do arquivo. Escritas e leituras parciais de setor passam por ele, e os setores modificados so
+    // sao gravados quando outro bloco ocupa o cache, em myfsFlush ou em myfsClose
+    unsigned char* cacheData;     // Alocado no primeiro uso, com diskBlockSize bytes
+    unsigned int cacheBlock;      // Endereco do bloco em cache, 0 se o cache esta vazio
+    unsigned int cacheDirtyStart; // Setores [cacheDirtyStart, cacheDirtyEnd) do bloco ainda nao gravados no disco
+    unsigned int cacheDirtyEnd;
+
+    // Leitura antecipada de arquivos comuns: leituras que continuam de onde a anterior parou trazem para raData os
+    // proximos raWindow blocos do arquivo de uma so vez, em ordem de endereco no disco. A janela dobra a cada leitura
+    // sequencial e cai pela metade a cada acesso fora da sequencia
+    unsigned char* raData;        // Alocado no primeiro uso, com READ_AHEAD_MAX_BLOCKS blocos
+    unsigned int* raBlocks;       // Endereco de cada bloco em raData, alocado junto com ele
+    unsigned int raStart;         // Numero no arquivo do primeiro bloco em raData
+    unsigned int raCount;         // Numero de blocos validos em raData, 0 se vazio
+    unsigned int raWindow;
+    unsigned int raNextByte;      // Posicao em que terminou a ultima leitura
+
+    // Numeros dos inodes das extensoes do arquivo ja percorridas pelas buscas de enderecos de blocos do descritor, em
+    // ordem na cadeia, para que um bloco em uma delas seja encontrado com a leitura de uma unica extensao. Descartados
+    // junto com a leitura antecipada, antes de o mapa de blocos mudar
+    unsigned int* extChain;       // Alocado no primeiro uso
+    unsigned int extChainLength;
+    unsigned int extChainCapacity;
+
+    // Geracao do descritor, renovada a cada alteracao no conteudo ou no mapa de blocos do arquivo. Mapeamentos feitos
+    // em outra geracao deixam de ser validos
+    unsigned int generation;
 } FileInfo;
 
 
@@ -49,4 +111,63 @@ typedef struct
     unsigned int inumber;
 } DirectoryEntry;
 
+
+// Relatorio de uma passada de myfsDefrag. Sequencias contam os trechos contiguos dos mapas de blocos, uma por arquivo
+// sem fragmentacao, e cilindros estimam o deslocamento das cabecas do disco para ler cada arquivo em ordem
+typedef struct
+{
+    unsigned int filesScanned;
+    unsigned int filesFragmented;
+    unsigned int filesDefragmented;
+    unsigned int blocksMoved;
+    unsigned int runsBefore;
+    unsigned int runsAfter;
+    unsigned long seekCylindersBefore;
+    unsigned long seekCylindersAfter;
+} DefragReport;
+
+int myfsDefrag(Disk *d, unsigned int maxBlocksMoved, DefragReport *report);
+
+
+// Visao somente leitura dos bytes de um arquivo, criada por myfsMmap. Cada pagina corresponde a um bloco do arquivo e
+// so e lida do disco no primeiro acesso por myfsMapFault. Quando as paginas em memoria atingem o limite de memoria do
+// mapeamento, uma pagina pouco usada e descartada, escolhida pelo algoritmo do relogio. O endereco devolvido por
+// myfsMapFault so e garantido ate a proxima chamada sobre o mesmo mapeamento. Qualquer alteracao no conteudo ou no
+// mapa de blocos do arquivo, por qualquer descritor, e o fechamento do descritor invalidam o mapeamento: myfsMapFault
+// passa a retornar NULL, e o mapeamento deve ser desfeito com myfsMunmap
+typedef struct
+{
+    int fd;
+    unsigned int generation;       // Geracao do descritor no momento do mapeamento
+    unsigned int length;           // Tamanho do arquivo no momento do mapeamento
+    unsigned int pageSize;         // Igual ao tamanho de bloco do disco
+    unsigned int numPages;
+    unsigned int* blocks;          // Mapa de blocos do arquivo, lido uma unica vez
+    unsigned char* memory;         // maxResidentPages paginas, alocadas de uma so vez
+    unsigned char** pages;         // Endereco de cada pagina em memory, NULL se a pagina nao esta carregada
+    unsigned char* referenced;     // Pagina acessada desde a ultima passagem do ponteiro do relogio
+    unsigned int* slotPage;        // Pagina que ocupa cada posicao de memory
+    unsigned int usedSlots;
+    unsigned int maxResidentPages;
+    unsigned int clockHand;
+} FileMapping;
+
+FileMapping* myfsMmap(int fd, unsigned int memoryBudget);
+const char* myfsMapFault(FileMapping *map, unsigned int offset, unsigned int *length);
+int myfsMunmap(FileMapping *map);
+
+
+// Leituras e escritas assincronas, executadas por um conjunto fixo de threads. Cada operacao le ou escreve a partir de
+// offset, como myfsPread e myfsPwrite, e ao terminar chama callback na thread que a executou, com o descritor, o
+// resultado da operacao e arg. buf deve continuar valido ate a chamada de callback. As operacoes assincronas sao
+// executadas uma de cada vez, sem ordem garantida entre elas. As funcoes do myfs sao serializadas por uma trava, e
+// podem ser chamadas por qualquer thread, inclusive pelos callbacks, enquanto houver operacoes pendentes. myfsClose
+// espera o fim das operacoes do descritor, e myfsAsyncWait, que nao deve ser chamada por um callback, o fim de todas
+typedef void (*AsyncCallback)(int fd, int result, void *arg);
+
+int myfsReadAsync(int fd, char *buf, unsigned int nbytes, unsigned int offset, AsyncCallback callback, void *arg);
+int myfsWriteAsync(int fd, const char *buf, unsigned int nbytes, unsigned int offset, AsyncCallback callback,
+                   void *arg);
+int myfsAsyncWait(void);
+
 #endif //SO_TRABALHO2_MYFS_H
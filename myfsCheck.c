@@ -0,0 +1,185 @@
+/*
+*  myfsCheck.c - Verificacoes independentes das funcoes auxiliares do myfs que nao dependem de um disco, executadas
+*                fora do simulador. Compilar com todos os fontes exceto main.c:
+*
+*                gcc -o myfsCheck myfsCheck.c myfs.c myfsInternalFunctions.c disk.c inode.c vfs.c util.c -lpthread
+*
+*  Autores: Eduardo Pereira do Valle - 201665554AC
+*           Felipe Terrana Cazetta - 201635026
+*           Matheus Brinati Altomar - 201665564C
+*           Vinicius Alberto Alves da Silva - 201665558AC
+*
+*  Projeto: Trabalho Pratico II - Sistemas Operacionais
+*  Organizacao: Universidade Federal de Juiz de Fora
+*  Departamento: Dep. Ciencia da Computacao
+*
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "myfsInternalFunctions.h"
+
+/// Maior bloco verificado, igual ao maior tamanho de bloco aceito por myfsFormat
+#define CHECK_BLOCK_SIZE 4096
+
+/// Espaco suficiente para comprimir CHECK_BLOCK_SIZE bytes no pior caso, em que nenhuma repeticao e encontrada
+#define CHECK_COMPRESSED_SIZE (CHECK_BLOCK_SIZE + CHECK_BLOCK_SIZE / 255 + 16)
+
+unsigned int checkFailures = 0;
+
+
+
+
+// Registra o resultado de uma verificacao, imprimindo description se ela falhou
+void check(bool passed, const char *description)
+{
+    if(passed) return;
+
+    printf("FALHOU: %s\n", description);
+    checkFailures++;
+}
+
+
+
+
+// Comprime os size bytes de data em no maximo capacity bytes e, se couberem, descomprime o resultado seguido de bytes
+// que nao fazem parte dele, como o restante do ultimo setor de um bloco comprimido, verificando que os dados voltam
+// iguais. Retorna o tamanho dos dados comprimidos, ou 0 se eles nao couberem em capacity bytes
+unsigned int checkRoundTrip(const unsigned char *data, unsigned int size, unsigned int capacity,
+                            const char *description)
+{
+    unsigned char compressed[CHECK_COMPRESSED_SIZE + DISK_SECTORDATASIZE];
+    unsigned char restored[CHECK_BLOCK_SIZE];
+
+    memset(compressed, 0xA5, sizeof(compressed));
+    unsigned int compressedSize = __compressBlock(data, size, compressed, capacity);
+    if(compressedSize == 0) return 0;
+
+    check(compressedSize <= capacity, description);
+
+    memset(restored, 0x5A, sizeof(restored));
+    check(__decompressBlock(compressed, compressedSize + DISK_SECTORDATASIZE, restored, size) &&
+          memcmp(restored, data, size) == 0, description);
+
+    return compressedSize;
+}
+
+
+
+
+// Verifica a compressao de blocos (__compressBlock e __decompressBlock) com dados incompressiveis, zerados e com
+// repeticoes que se sobrepoem ao trecho sendo escrito, inclusive a desistencia quando os dados nao cabem em capacity
+void checkCompression()
+{
+    unsigned char data[CHECK_BLOCK_SIZE];
+    unsigned char compressed[CHECK_COMPRESSED_SIZE];
+    unsigned char restored[CHECK_BLOCK_SIZE];
+    unsigned int i;
+
+    // Bytes pseudo-aleatorios nao possuem repeticoes, e a compressao so cabe com espaco alem do tamanho original
+    unsigned int seed = 12345;
+    for(i = 0; i < CHECK_BLOCK_SIZE; i++)
+    {
+        seed = seed * 1103515245u + 12345u;
+        data[i] = (unsigned char) (seed >> 16);
+    }
+
+    check(__compressBlock(data, CHECK_BLOCK_SIZE, compressed, CHECK_BLOCK_SIZE) == 0,
+          "dados incompressiveis nao cabem no tamanho original");
+    check(checkRoundTrip(data, CHECK_BLOCK_SIZE, CHECK_COMPRESSED_SIZE, "dados incompressiveis") > CHECK_BLOCK_SIZE,
+          "dados incompressiveis comprimidos com espaco de sobra");
+
+    // Um bloco zerado vira uma unica repeticao longa, de distancia 1, com tamanho estendido
+    memset(data, 0, CHECK_BLOCK_SIZE);
+    unsigned int zeroSize = checkRoundTrip(data, CHECK_BLOCK_SIZE, CHECK_COMPRESSED_SIZE, "bloco zerado");
+    check(zeroSize > 0 && zeroSize < 64, "bloco zerado comprime para poucos bytes");
+
+    // A desistencia vale para qualquer capacidade menor que o necessario, e o tamanho exato basta
+    check(checkRoundTrip(data, CHECK_BLOCK_SIZE, zeroSize, "bloco zerado no tamanho exato") == zeroSize,
+          "bloco zerado cabe no tamanho exato");
+    for(i = 0; i < zeroSize; i++)
+        check(__compressBlock(data, CHECK_BLOCK_SIZE, compressed, i) == 0, "bloco zerado nao cabe em menos bytes");
+
+    // Padroes curtos repetidos produzem repeticoes com distancia menor que o seu tamanho
+    unsigned int period;
+    for(period = 1; period <= 7; period++)
+    {
+        for(i = 0; i < CHECK_BLOCK_SIZE; i++) data[i] = (unsigned char) ("myfs LZ4"[i % period]);
+        check(checkRoundTrip(data, CHECK_BLOCK_SIZE, CHECK_COMPRESSED_SIZE, "padrao repetido") > 0,
+              "padrao repetido comprime");
+    }
+
+    // Trechos repetidos entre literais, com blocos de tamanhos que nao sao multiplos de setor
+    for(i = 0; i < CHECK_BLOCK_SIZE; i++) data[i] = (unsigned char) (i % 300 < 40 ? i * 7 : i % 300 < 200 ? 'a' : i);
+    unsigned int size;
+    for(size = 1; size <= CHECK_BLOCK_SIZE; size = size * 3 + 1)
+        check(checkRoundTrip(data, size, CHECK_COMPRESSED_SIZE, "literais e repeticoes") > 0,
+              "literais e repeticoes comprimem");
+
+    // Dados comprimidos truncados sao rejeitados
+    memset(data, 0, CHECK_BLOCK_SIZE);
+    zeroSize = __compressBlock(data, CHECK_BLOCK_SIZE, compressed, CHECK_COMPRESSED_SIZE);
+    check(!__decompressBlock(compressed, zeroSize - 1, restored, CHECK_BLOCK_SIZE), "dados truncados");
+}
+
+
+
+
+// Verifica o CRC32C pelo valor conhecido da sequencia "123456789", 0xE3069283, no calculo por tabelas e no calculo
+// com a instrucao do SSE4.2, quando o processador a possui, e compara os dois em trechos de tamanhos e alinhamentos
+// variados
+void checkCrc32c()
+{
+    const unsigned char* sample = (const unsigned char*) "123456789";
+
+    check(~__crc32cSoftware(~0u, sample, 9) == 0xE3069283u, "CRC32C por tabelas de \"123456789\"");
+    check(__crc32c(sample, 9) == 0xE3069283u, "CRC32C de \"123456789\"");
+    check(__crc32c(sample, 0) == 0, "CRC32C de zero bytes");
+
+    // Um trecho dividido em duas chamadas resulta no mesmo CRC de uma chamada so
+    check(~__crc32cSoftware(__crc32cSoftware(~0u, sample, 4), &sample[4], 5) == 0xE3069283u,
+          "CRC32C por tabelas em duas partes");
+
+#ifdef CRC32C_SSE42
+    if(!__builtin_cpu_supports("sse4.2"))
+    {
+        printf("Processador sem SSE4.2: CRC32C verificado apenas por tabelas\n");
+        return;
+    }
+
+    check(~__crc32cHardware(~0u, sample, 9) == 0xE3069283u, "CRC32C por SSE4.2 de \"123456789\"");
+
+    unsigned char data[DISK_SECTORDATASIZE + 8];
+    unsigned int i;
+    for(i = 0; i < sizeof(data); i++) data[i] = (unsigned char) (i * 31 + 7);
+
+    unsigned int start, size;
+    for(start = 0; start < 8; start++)
+    {
+        for(size = 0; size + start <= sizeof(data); size++)
+            check(__crc32cHardware(~0u, &data[start], size) == __crc32cSoftware(~0u, &data[start], size),
+                  "CRC32C por SSE4.2 igual ao calculado por tabelas");
+    }
+#else
+    printf("Compilado sem SSE4.2: CRC32C verificado apenas por tabelas\n");
+#endif
+}
+
+
+
+
+int main()
+{
+    checkCompression();
+    checkCrc32c();
+
+    if(checkFailures > 0)
+    {
+        printf("%u verificacoes falharam\n", checkFailures);
+        return 1;
+    }
+
+    printf("OK\n");
+    return 0;
+}
\ No newline at end of file
@@ -14,14 +14,34 @@
 
 #include "myfsInternalFunctions.h"
 
+#include <limits.h>
 #include <stdlib.h>
 #include <string.h>
 #include "util.h"
 
+#ifdef CRC32C_SSE42
+#include <nmmintrin.h>
+#endif
+
 // 255 significa que os 8 bits sao iguais a 1. Se for diferente de 255 pelo menos um bit e 0, representando
 // um bloco livre no disco
 #define NON_ZERO_BYTE 255
 
+// Numero de blocos representados por um setor do mapa de bits
+#define BITS_PER_BITMAP_SECTOR (DISK_SECTORDATASIZE * 8)
+
+// Parametros do compressor de blocos, no formato de bloco do LZ4: bits do hash de 4 bytes, menor repeticao, numero de
+// bytes finais sempre escritos como literais, distancia do fim a partir da qual nao se buscam repeticoes e maior
+// distancia de uma repeticao
+#define LZ_HASH_BITS 12
+#define LZ_MIN_MATCH 4
+#define LZ_LAST_LITERALS 5
+#define LZ_MATCH_LIMIT 12
+#define LZ_MAX_OFFSET 65535
+
+// Marca, no contexto do disco, um setor da tabela de referencias cujos blocos compartilhados ainda nao foram contados
+#define SHARED_COUNT_UNKNOWN UINT_MAX
+
 int myfsSlot = -1;
 
 FSInfo myfsInfo =
@@ -43,6 +63,17 @@ FSInfo myfsInfo =
 
 FileInfo* openFiles[MAX_FDS] = {NULL};
 
+MountInfo mounts[MAX_MOUNTS] = {{NULL}};
+
+OpenInode openInodes[MAX_OPEN_INODES] = {{NULL}};
+
+AsyncPool asyncPool = {.lock = PTHREAD_MUTEX_INITIALIZER, .workAvailable = PTHREAD_COND_INITIALIZER,
+                       .allDone = PTHREAD_COND_INITIALIZER, .fsLockInit = PTHREAD_ONCE_INIT,
+                       .fdDone = PTHREAD_COND_INITIALIZER};
+
+// Ultima geracao dada a um descritor, em sua abertura ou em uma alteracao no conteudo ou no mapa de blocos do arquivo
+unsigned int fileGeneration = 0;
+
 
 
 
@@ -52,11 +83,11 @@ int __firstZeroBit(unsigned char byte)
 {
     if(byte == NON_ZERO_BYTE) return -1;
 
-    int i;
+    unsigned int i;
     unsigned char mask = 1;
-    for(i=0; i < sizeof(unsigned char); i++)
+    for(i=0; i < 8 * sizeof(unsigned char); i++)
     {
-        if( (mask & byte) == 0 ) return i;
+        if( (mask & byte) == 0 ) return (int) i;
         mask <<= (unsigned char) 1;
     }
 
@@ -87,214 +118,3865 @@ unsigned char __setBitToZero(unsigned char byte, unsigned int bit)
 
 
 
-// Encontra um bloco livre no disco e o marca como ocupado se este estiver em formato myfs. Retorna 0 se nao houver
-// bloco livre ou se o disco nao estiver formatado corretamente
-unsigned int __findFreeBlock(Disk *d)
+
+// Marca count blocos consecutivos do mapa de bits, a partir do bloco de indice firstIndex (contado a partir do inicio
+// da area de blocos), como ocupados (used = true) ou livres (used = false). Cada setor do mapa de bits envolvido e lido
+// e escrito apenas uma vez. Retorna true (!= 0) se a operacao foi bem sucedida e false (0) caso contrario
+bool __markBlockRange(Disk *d, unsigned int firstIndex, unsigned int count, bool used)
 {
+    MountInfo* mount = __getMountInfo(d);
+    if(mount == NULL) return false;
+
     unsigned char buffer[DISK_SECTORDATASIZE];
-    if(diskReadSector(d, 0, buffer) == -1) return 0; // Superbloco inicialmente carregado no buffer
+    unsigned int index = firstIndex;
+
+    while(index < firstIndex + count)
+    {
+        unsigned int sectorIndex = index / BITS_PER_BITMAP_SECTOR;
+        if(diskReadSector(d, mount->freeSpaceSector + sectorIndex, buffer) == -1) return false;
+
+        // Altera todos os bits da faixa que pertencem ao setor carregado antes de escreve-lo de volta
+        do
+        {
+            unsigned int bit = index % BITS_PER_BITMAP_SECTOR;
+            if( ((buffer[bit / 8] >> (bit % 8)) & 1) != used ) __countGroupBlock(mount, index, used);
+
+            buffer[bit / 8] = used ? __setBitToOne(buffer[bit / 8], bit % 8) :
+                                     __setBitToZero(buffer[bit / 8], bit % 8);
+            index++;
+        } while(index < firstIndex + count && index % BITS_PER_BITMAP_SECTOR != 0);
+
+        if(diskWriteSector(d, mount->freeSpaceSector + sectorIndex, buffer) == -1)
+        {
+            __invalidateFreeSpaceSummary(mount);
+            __invalidateFreeExtents(mount);
+            return false;
+        }
+
+        __updateFreeSpaceSummary(mount, sectorIndex, buffer);
+        __updateFreeExtents(mount, sectorIndex, buffer);
+    }
+
+    return true;
+}
+
+
+
+
+// Retorna o contexto do disco d, lendo o superbloco e criando o contexto se este for o primeiro acesso ao disco desde
+// sua montagem ou formatacao. Se todas as posicoes estiverem ocupadas, reaproveita a de um disco sem arquivos
+// abertos. Retorna NULL se o disco nao estiver em formato myfs, se todas as posicoes forem de discos com arquivos
+// abertos ou em caso de erro
+MountInfo* __getMountInfo(Disk *d)
+{
+    if(d == NULL) return NULL;
+
+    int i;
+    for(i=0; i < MAX_MOUNTS; i++)
+    {
+        if(mounts[i].disk == d && mounts[i].diskId == diskGetId(d)) return &mounts[i];
+    }
+
+    unsigned char superblock[DISK_SECTORDATASIZE];
+    if(diskReadSector(d, 0, superblock) == -1) return NULL;
+
+    if(superblock[SUPERBLOCK_FSID] != myfsInfo.fsid) return NULL;
+
+    // Procura uma posicao livre ou, na falta dela, uma cujo disco nao tenha arquivos abertos. O ponteiro guardado pode
+    // ser de um disco ja desconectado, entao ele e apenas comparado e nunca acessado
+    MountInfo* mount = NULL;
+    for(i=0; i < MAX_MOUNTS && mount == NULL; i++)
+    {
+        if(mounts[i].disk == NULL) mount = &mounts[i];
+    }
+
+    for(i=0; i < MAX_MOUNTS && mount == NULL; i++)
+    {
+        bool idle = true;
+
+        int fd;
+        for(fd=0; fd < MAX_FDS && idle; fd++)
+        {
+            if(openFiles[fd] != NULL && openFiles[fd]->disk == mounts[i].disk) idle = false;
+        }
+
+        // Checksums nao gravados impedem o reaproveitamento, ja que o disco pode nem estar mais conectado
+        if(idle && !mounts[i].checksumsDirty) mount = &mounts[i];
+    }
+
+    // O contexto de um disco com arquivos abertos nunca e descartado, ja que o seu estado em memoria ainda e usado
+    if(mount == NULL) return NULL;
+
+    __discardMountInfo(mount);
+
+    char2ul(&superblock[SUPERBLOCK_BLOCKSIZE], &mount->blockSize);
+    char2ul(&superblock[SUPERBLOCK_FREE_SPACE_SECTOR], &mount->freeSpaceSector);
+    char2ul(&superblock[SUPERBLOCK_FIRST_BLOCK_SECTOR], &mount->firstBlockSector);
+    char2ul(&superblock[SUPERBLOCK_NUM_BLOCKS], &mount->numBlocks);
+    char2ul(&superblock[SUPERBLOCK_BLOCKS_PER_GROUP], &mount->blocksPerGroup);
+    char2ul(&superblock[SUPERBLOCK_REFCOUNT_SECTOR], &mount->refCountSector);
+    char2ul(&superblock[SUPERBLOCK_CHECKSUM_SECTOR], &mount->checksumSector);
+
+    mount->sectorsPerBlock = mount->blockSize / DISK_SECTORDATASIZE;
+    mount->numInodes = (mount->freeSpaceSector - inodeAreaBeginSector()) * inodeNumInodesPerSector();
+
+    // Discos formatados sem grupos sao tratados como um unico grupo
+    if(mount->blocksPerGroup == 0 || mount->blocksPerGroup > mount->numBlocks) mount->blocksPerGroup = mount->numBlocks;
+    if(mount->sectorsPerBlock == 0 || mount->blocksPerGroup == 0) return NULL;
+
+    mount->numGroups = (mount->numBlocks + mount->blocksPerGroup - 1) / mount->blocksPerGroup;
+    mount->inodesPerGroup = (mount->numInodes + mount->numGroups - 1) / mount->numGroups;
+
+    mount->disk = d;
+    mount->diskId = diskGetId(d);
+
+    return mount;
+}
+
+
+
+
+// Descarta o contexto do disco d, se existir, de modo que o superbloco seja lido novamente no proximo acesso. Deve ser
+// chamada sempre que o superbloco ou o mapa de bits forem reescritos por fora das funcoes de alocacao
+void __releaseMountInfo(Disk *d)
+{
+    int i;
+    for(i=0; i < MAX_MOUNTS; i++)
+    {
+        if(mounts[i].disk == d) __discardMountInfo(&mounts[i]);
+    }
+}
+
+
+
+
+
+// Libera o estado em memoria da posicao mount da tabela de contextos e a deixa livre
+void __discardMountInfo(MountInfo *mount)
+{
+    __invalidateFreeSpaceSummary(mount);
+    __invalidateFreeExtents(mount);
+    free(mount->sectorShared);
+    free(mount->dedupIndex);
+    free(mount->checksums);
+    free(mount->checksumDirty);
+    memset(mount, 0, sizeof(MountInfo));
+}
 
-    if(buffer[SUPERBLOCK_FSID] != myfsInfo.fsid) return 0;
 
-    unsigned int sectorsPerBlock;
-    char2ul(&buffer[SUPERBLOCK_BLOCKSIZE], &sectorsPerBlock);
-    sectorsPerBlock /= DISK_SECTORDATASIZE;
 
-    unsigned int numBlocks;
-    char2ul(&buffer[SUPERBLOCK_NUM_BLOCKS], &numBlocks);
 
-    unsigned int firstBlock;
-    char2ul(&buffer[SUPERBLOCK_FIRST_BLOCK_SECTOR], &firstBlock);
 
-    unsigned int freeSpaceSector;
-    char2ul(&buffer[SUPERBLOCK_FREE_SPACE_SECTOR], &freeSpaceSector);
+// Garante que o resumo do mapa de bits do contexto mount esteja carregado, construindo-o com uma leitura sequencial do
+// mapa de bits se necessario. Retorna true (!= 0) em caso de sucesso e false (0) caso contrario
+bool __loadFreeSpaceSummary(MountInfo *mount)
+{
+    FreeSpaceSummary* summary = &mount->freeSpace;
+    if(summary->sectorFree != NULL) return true;
+
+    unsigned int numSectors = (mount->numBlocks + BITS_PER_BITMAP_SECTOR - 1) / BITS_PER_BITMAP_SECTOR;
+    unsigned int wordsPerSector = BITS_PER_BITMAP_SECTOR / BITMAP_WORD_BITS;
+
+    summary->numSectors = numSectors;
+    summary->totalFree = 0;
+    summary->groupFree = calloc(mount->numGroups + 1, sizeof(unsigned int));
+    summary->sectorFree = calloc(numSectors + 1, sizeof(unsigned int));
+    summary->sectorHeadRun = calloc(numSectors + 1, sizeof(unsigned int));
+    summary->sectorTailRun = calloc(numSectors + 1, sizeof(unsigned int));
+    summary->sectorMaxRun = calloc(numSectors + 1, sizeof(unsigned int));
+    summary->wordHasFree = calloc(numSectors * wordsPerSector / 8 + 1, sizeof(unsigned char));
+
+    if(summary->groupFree == NULL || summary->sectorFree == NULL || summary->sectorHeadRun == NULL ||
+       summary->sectorTailRun == NULL || summary->sectorMaxRun == NULL || summary->wordHasFree == NULL)
+    {
+        __invalidateFreeSpaceSummary(mount);
+        return false;
+    }
 
-    unsigned int freeSpaceSize = firstBlock - freeSpaceSector;
+    unsigned char buffer[DISK_SECTORDATASIZE];
 
     unsigned int i;
-    for(i = freeSpaceSector; i < freeSpaceSector + freeSpaceSize; i++)
+    for(i=0; i < numSectors; i++)
     {
-        if(diskReadSector(d, i, buffer) == -1) return 0;
+        if(diskReadSector(mount->disk, mount->freeSpaceSector + i, buffer) == -1)
+        {
+            __invalidateFreeSpaceSummary(mount);
+            return false;
+        }
 
-        unsigned int j;
-        for(j=0; j < DISK_SECTORDATASIZE; j++)
+        __updateFreeSpaceSummary(mount, i, buffer);
+
+        // A contagem de cada grupo e feita so aqui; depois, __countGroupBlock a mantem a cada bit alterado
+        unsigned int bit;
+        for(bit = 0; bit < BITS_PER_BITMAP_SECTOR && i * BITS_PER_BITMAP_SECTOR + bit < mount->numBlocks; bit++)
         {
-            int freeBit = __firstZeroBit(buffer[j]);
-            if(freeBit != -1)
-            {
-                unsigned int freeBlock = firstBlock +
-                                         (i - freeSpaceSector) * DISK_SECTORDATASIZE * 8 * sectorsPerBlock +
-                                         j * 8 * sectorsPerBlock +
-                                         freeBit * sectorsPerBlock;
+            if( ((buffer[bit / 8] >> (bit % 8)) & 1) == 0 )
+                summary->groupFree[(i * BITS_PER_BITMAP_SECTOR + bit) / mount->blocksPerGroup]++;
+        }
+    }
 
-                // Bloco livre excede a regiao de blocos disponiveis, nenhum bloco livre valido foi encontrado
-                if((freeBlock - firstBlock) / sectorsPerBlock >= numBlocks) return 0;
+    return true;
+}
 
-                buffer[j] = __setBitToOne(buffer[j], freeBit);
-                if(diskWriteSector(d, i, buffer) == -1) return 0;
 
-                return freeBlock;
-            }
+
+
+
+// Recalcula o resumo do setor sectorIndex do mapa de bits (contado a partir do primeiro setor do mapa) a partir do
+// conteudo atual do setor em bitmapSector. Nao faz nada se o resumo nao estiver carregado
+void __updateFreeSpaceSummary(MountInfo *mount, unsigned int sectorIndex, const unsigned char *bitmapSector)
+{
+    FreeSpaceSummary* summary = &mount->freeSpace;
+    if(summary->sectorFree == NULL || sectorIndex >= summary->numSectors) return;
+
+    unsigned int firstIndex = sectorIndex * BITS_PER_BITMAP_SECTOR;
+    unsigned int numBits = mount->numBlocks - firstIndex;
+    if(numBits > BITS_PER_BITMAP_SECTOR) numBits = BITS_PER_BITMAP_SECTOR;
+
+    unsigned int freeCount = 0, headRun = 0, maxRun = 0, run = 0;
+    bool inHead = true;
+
+    unsigned int bit;
+    for(bit = 0; bit < numBits; bit++)
+    {
+        unsigned int word = (firstIndex + bit) / BITMAP_WORD_BITS;
+        if(bit % BITMAP_WORD_BITS == 0)
+            summary->wordHasFree[word / 8] = __setBitToZero(summary->wordHasFree[word / 8], word % 8);
+
+        if( (bitmapSector[bit / 8] >> (bit % 8)) & 1 )
+        {
+            inHead = false;
+            run = 0;
+            continue;
         }
+
+        summary->wordHasFree[word / 8] = __setBitToOne(summary->wordHasFree[word / 8], word % 8);
+        freeCount++;
+        run++;
+
+        if(inHead) headRun++;
+        if(run > maxRun) maxRun = run;
     }
 
-    return -1;
+    summary->totalFree += freeCount;
+    summary->totalFree -= summary->sectorFree[sectorIndex];
+
+    summary->sectorFree[sectorIndex] = freeCount;
+    summary->sectorHeadRun[sectorIndex] = headRun;
+    summary->sectorTailRun[sectorIndex] = run;
+    summary->sectorMaxRun[sectorIndex] = maxRun;
 }
 
 
 
 
-// Dado um bloco em um disco formatado em myfs, marca o bloco como livre para uso. Retorna true (!= 0) se a operacao
-// foi bem sucedida e false (0) se algum erro ocorreu no processo
-bool __setBlockFree(Disk *d, unsigned int block)
+
+// Registra no resumo do mapa de bits do contexto mount a passagem do bloco de indice index (contado a partir do inicio
+// da area de blocos) para ocupado (used = true) ou livre (used = false), atualizando a contagem de blocos livres do seu
+// grupo. Deve ser chamada apenas quando o bit do bloco realmente muda. Nao faz nada se o resumo nao estiver carregado
+void __countGroupBlock(MountInfo *mount, unsigned int index, bool used)
 {
-    unsigned char buffer[DISK_SECTORDATASIZE];
-    if(diskReadSector(d, 0, buffer) == -1) return false;
+    FreeSpaceSummary* summary = &mount->freeSpace;
+    if(summary->groupFree == NULL) return;
 
-    if(buffer[SUPERBLOCK_FSID] != myfsInfo.fsid) return false;
+    if(used) summary->groupFree[index / mount->blocksPerGroup]--;
+    else summary->groupFree[index / mount->blocksPerGroup]++;
+}
 
-    unsigned int sectorsPerBlock;
-    char2ul(&buffer[SUPERBLOCK_BLOCKSIZE], &sectorsPerBlock);
-    sectorsPerBlock /= DISK_SECTORDATASIZE;
 
-    unsigned int numBlocks;
-    char2ul(&buffer[SUPERBLOCK_NUM_BLOCKS], &numBlocks);
 
-    unsigned int firstBlock;
-    char2ul(&buffer[SUPERBLOCK_FIRST_BLOCK_SECTOR], &firstBlock);
 
-    unsigned int freeSpaceStartSector;
-    char2ul(&buffer[SUPERBLOCK_FREE_SPACE_SECTOR], &freeSpaceStartSector);
 
-    // Bloco de entrada excede a regiao de blocos disponiveis
-    if((block - firstBlock) / sectorsPerBlock >= numBlocks) return false;
+// Descarta o resumo do mapa de bits do contexto mount, forcando sua reconstrucao na proxima alocacao
+void __invalidateFreeSpaceSummary(MountInfo *mount)
+{
+    FreeSpaceSummary* summary = &mount->freeSpace;
+
+    free(summary->groupFree);
+    free(summary->sectorFree);
+    free(summary->sectorHeadRun);
+    free(summary->sectorTailRun);
+    free(summary->sectorMaxRun);
+    free(summary->wordHasFree);
 
-    unsigned int blockFreeSpaceSector = ((block - firstBlock) / sectorsPerBlock) / (DISK_SECTORDATASIZE * 8);
-    if(diskReadSector(d, blockFreeSpaceSector, buffer) == -1) return false;
+    memset(summary, 0, sizeof(FreeSpaceSummary));
+}
 
-    unsigned int blockFreeSpaceBit = ((block - firstBlock) / sectorsPerBlock) % (DISK_SECTORDATASIZE * 8);
-    buffer[blockFreeSpaceBit / 8] = __setBitToZero(buffer[blockFreeSpaceBit / 8], blockFreeSpaceBit % 8);
 
-    if(diskWriteSector(d, blockFreeSpaceSector, buffer) == -1) return false;
 
-    return true;
+
+
+// Retorna o numero de blocos livres do disco d, ou 0 em caso de erro
+unsigned int __getNumFreeBlocks(Disk *d)
+{
+    MountInfo* mount = __getMountInfo(d);
+    if(mount == NULL || !__loadFreeSpaceSummary(mount)) return 0;
+
+    return mount->freeSpace.totalFree;
 }
 
 
 
 
-// Le e retorna o tamanho do bloco de um disco em bytes, assumindo que ele esteja formatado em myfs.
-// Retorna 0 em caso de erro
-unsigned int __getBlockSize(Disk *d)
+
+// Retorna o tamanho, em blocos, da maior sequencia de blocos livres e contiguos do disco d, ou 0 em caso de erro
+unsigned int __getLargestFreeRun(Disk *d)
 {
-    unsigned char superblock[DISK_SECTORDATASIZE];
-    if(diskReadSector(d, 0, superblock) == -1) return 0;
+    MountInfo* mount = __getMountInfo(d);
+    if(mount == NULL || !__loadFreeSpaceSummary(mount)) return 0;
+
+    FreeSpaceSummary* summary = &mount->freeSpace;
+
+    // Setores totalmente livres emendam a sequencia do fim do setor anterior com a do inicio do proximo
+    unsigned int largest = 0, run = 0;
+    unsigned int i;
+    for(i=0; i < summary->numSectors; i++)
+    {
+        unsigned int numBits = mount->numBlocks - i * BITS_PER_BITMAP_SECTOR;
+        if(numBits > BITS_PER_BITMAP_SECTOR) numBits = BITS_PER_BITMAP_SECTOR;
 
-    if(superblock[SUPERBLOCK_FSID] != myfsInfo.fsid) return 0;
+        if(summary->sectorFree[i] == numBits)
+        {
+            run += numBits;
+            continue;
+        }
 
-    unsigned int blockSize;
-    char2ul(&superblock[SUPERBLOCK_BLOCKSIZE], &blockSize);
+        if(run + summary->sectorHeadRun[i] > largest) largest = run + summary->sectorHeadRun[i];
+        if(summary->sectorMaxRun[i] > largest) largest = summary->sectorMaxRun[i];
+        run = summary->sectorTailRun[i];
+    }
 
-    return blockSize;
+    return run > largest ? run : largest;
 }
 
 
 
 
-// Funciona como um openDir para o diretorio raiz de um disco. Pode ser fechado normalmnte atraves de myfsClosedir.
-// Retorna um descritor de arquivo em caso de sucesso e -1 em caso de erro
-int __openRoot(Disk *d)
+// Compara duas extensoes livres na ordem da arvore tree: por posicao (EXTENT_BY_OFFSET) ou por tamanho e, em caso de
+// empate, por posicao (EXTENT_BY_LENGTH). Retorna um valor negativo, zero ou positivo, como em qsort
+int __compareExtents(const FreeExtent *a, const FreeExtent *b, int tree)
 {
-    int fd;
-    for(fd = 1; fd <= MAX_FDS; fd++)
+    if(tree == EXTENT_BY_LENGTH && a->length != b->length) return a->length < b->length ? -1 : 1;
+    return a->start < b->start ? -1 : a->start > b->start;
+}
+
+
+
+
+// Retorna a altura da subarvore node na arvore tree, sendo 0 a altura de uma subarvore vazia
+int __extentHeight(FreeExtent *node, int tree)
+{
+    return node == NULL ? 0 : node->height[tree];
+}
+
+
+
+
+// Recalcula a altura de node na arvore tree a partir de seus filhos e, na arvore por posicao, o maior tamanho de
+// extensao da subarvore
+void __extentUpdate(FreeExtent *node, int tree)
+{
+    int leftHeight = __extentHeight(node->left[tree], tree);
+    int rightHeight = __extentHeight(node->right[tree], tree);
+    node->height[tree] = 1 + (leftHeight > rightHeight ? leftHeight : rightHeight);
+
+    if(tree == EXTENT_BY_OFFSET)
     {
-        if(openFiles[fd-1] == NULL) break;
+        node->maxLength = node->length;
+        if(node->left[tree] != NULL && node->left[tree]->maxLength > node->maxLength)
+            node->maxLength = node->left[tree]->maxLength;
+        if(node->right[tree] != NULL && node->right[tree]->maxLength > node->maxLength)
+            node->maxLength = node->right[tree]->maxLength;
     }
+}
 
-    if(fd > MAX_FDS) return -1;
 
-    FileInfo* root = openFiles[fd-1] = malloc(sizeof(FileInfo));
-    root->disk = d;
-    root->diskBlockSize = __getBlockSize(d);
-    root->inode = inodeLoad(ROOT_DIRECTORY_INODE, d);
-    root->currentByte = 0;
 
-    if(root->diskBlockSize == 0 || root->inode == NULL)
+
+// Rotaciona a subarvore node da arvore tree para a esquerda (toLeft = true) ou para a direita. Retorna a nova raiz da
+// subarvore
+FreeExtent* __extentRotate(FreeExtent *node, int tree, bool toLeft)
+{
+    FreeExtent* pivot;
+    if(toLeft)
     {
-        free(root);
-        openFiles[fd-1] = NULL;
-        return -1;
+        pivot = node->right[tree];
+        node->right[tree] = pivot->left[tree];
+        pivot->left[tree] = node;
+    }
+    else
+    {
+        pivot = node->left[tree];
+        node->left[tree] = pivot->right[tree];
+        pivot->right[tree] = node;
     }
 
-    return fd;
+    __extentUpdate(node, tree);
+    __extentUpdate(pivot, tree);
+    return pivot;
 }
 
 
 
 
-bool __deleteFile(Disk *d, Inode *inode)
+// Restaura o balanceamento AVL da subarvore node da arvore tree apos uma insercao ou remocao em um de seus filhos.
+// Retorna a nova raiz da subarvore
+FreeExtent* __extentBalance(FreeExtent *node, int tree)
 {
-    unsigned int blockCount = 0;
-    unsigned int currentBlock = inodeGetBlockAddr(inode, blockCount);
+    __extentUpdate(node, tree);
+    int balance = __extentHeight(node->left[tree], tree) - __extentHeight(node->right[tree], tree);
+
+    if(balance > 1)
+    {
+        FreeExtent* left = node->left[tree];
+        if(__extentHeight(left->left[tree], tree) < __extentHeight(left->right[tree], tree))
+            node->left[tree] = __extentRotate(left, tree, true);
+        return __extentRotate(node, tree, false);
+    }
 
-    while (currentBlock > 0)
+    if(balance < -1)
     {
-        __setBlockFree(d, currentBlock);
-        blockCount++;
-        currentBlock = inodeGetBlockAddr(inode, blockCount);
+        FreeExtent* right = node->right[tree];
+        if(__extentHeight(right->right[tree], tree) < __extentHeight(right->left[tree], tree))
+            node->right[tree] = __extentRotate(right, tree, false);
+        return __extentRotate(node, tree, true);
     }
 
-    return inodeClear(inode) == -1 ? false : true;
+    return node;
 }
 
 
 
 
-bool __deleteDir(Disk *d, Inode *inode, Inode *parent)
+// Insere node na arvore tree de raiz root. Retorna a nova raiz da arvore
+FreeExtent* __extentInsert(FreeExtent *root, FreeExtent *node, int tree)
 {
-    // Existem outras entradas no diretorio alem de . e ..
-    if(inodeGetFileSize(inode) > 2 * sizeof(DirectoryEntry)) return false;
+    if(root == NULL)
+    {
+        node->left[tree] = NULL;
+        node->right[tree] = NULL;
+        __extentUpdate(node, tree);
+        return node;
+    }
 
-    unsigned int parentPreviousRefCount = inodeGetRefCount(parent);
-    inodeSetRefCount(parent, parentPreviousRefCount - 1);
-    inodeSave(parent);
+    if(__compareExtents(node, root, tree) < 0) root->left[tree] = __extentInsert(root->left[tree], node, tree);
+    else root->right[tree] = __extentInsert(root->right[tree], node, tree);
 
-    return __deleteFile(d, inode);
+    return __extentBalance(root, tree);
 }
 
 
 
 
-bool __autoLink(int fd)
+// Remove da arvore tree de raiz root o menor no, escrito em *min. Retorna a nova raiz da arvore
+FreeExtent* __extentRemoveMin(FreeExtent *root, FreeExtent **min, int tree)
 {
-    if(fd <= 0 || fd > MAX_FDS) return false;
-    FileInfo* dir = openFiles[fd-1];
+    if(root->left[tree] == NULL)
+    {
+        *min = root;
+        return root->right[tree];
+    }
 
-    if(dir == NULL || inodeGetFileType(dir->inode) != FILETYPE_DIR) return false;
+    root->left[tree] = __extentRemoveMin(root->left[tree], min, tree);
+    return __extentBalance(root, tree);
+}
 
-    unsigned int dirInumber = inodeGetNumber(dir->inode); // Atualiza inode do diretorio na memoria
-    free(dir->inode);
-    dir->inode = inodeLoad(dirInumber, dir->disk);
 
-    DirectoryEntry entry;
-    strcpy(entry.filename, ".");
-    entry.inumber = inodeGetNumber(dir->inode);
 
-    inodeSetRefCount(dir->inode, 1);
 
-    dir->currentByte = 0;
-    int bytesWritten = myfsWrite(fd, (const char*) &entry, sizeof(DirectoryEntry));
-    dir->currentByte = 0;
+// Remove node da arvore tree de raiz root, sem libera-lo. Retorna a nova raiz da arvore
+FreeExtent* __extentRemove(FreeExtent *root, FreeExtent *node, int tree)
+{
+    if(root == NULL) return NULL;
 
-    if(bytesWritten != sizeof(DirectoryEntry)) // Falha na insercao da entrada
+    int comparison = __compareExtents(node, root, tree);
+    if(comparison < 0) root->left[tree] = __extentRemove(root->left[tree], node, tree);
+    else if(comparison > 0) root->right[tree] = __extentRemove(root->right[tree], node, tree);
+    else
     {
-        // Diretorio volta ao tamanho original, caso a escrita tenha sido valida mas incompleta
-        inodeSetFileSize(dir->inode, 0);
-        inodeSave(dir->inode);
-
-        return false;
+        FreeExtent* left = root->left[tree];
+        FreeExtent* right = root->right[tree];
+        if(right == NULL) return left;
+
+        FreeExtent* successor;
+        right = __extentRemoveMin(right, &successor, tree);
+        successor->left[tree] = left;
+        successor->right[tree] = right;
+        return __extentBalance(successor, tree);
     }
 
-    inodeSave(dir->inode);
+    return __extentBalance(root, tree);
+}
+
+
+
+
+// Cria uma extensao livre com length blocos a partir do indice start e a insere nas duas arvores do contexto mount.
+// Retorna true (!= 0) em caso de sucesso e false (0) se nao houver memoria
+bool __addFreeExtent(MountInfo *mount, unsigned int start, unsigned int length)
+{
+    FreeExtent* extent = malloc(sizeof(FreeExtent));
+    if(extent == NULL) return false;
+
+    extent->start = start;
+    extent->length = length;
+
+    mount->extentRoot[EXTENT_BY_OFFSET] = __extentInsert(mount->extentRoot[EXTENT_BY_OFFSET], extent, EXTENT_BY_OFFSET);
+    mount->extentRoot[EXTENT_BY_LENGTH] = __extentInsert(mount->extentRoot[EXTENT_BY_LENGTH], extent, EXTENT_BY_LENGTH);
     return true;
-}
\ No newline at end of file
+}
+
+
+
+
+// Remove a extensao livre extent das duas arvores do contexto mount e a libera
+void __removeFreeExtent(MountInfo *mount, FreeExtent *extent)
+{
+    mount->extentRoot[EXTENT_BY_OFFSET] = __extentRemove(mount->extentRoot[EXTENT_BY_OFFSET], extent, EXTENT_BY_OFFSET);
+    mount->extentRoot[EXTENT_BY_LENGTH] = __extentRemove(mount->extentRoot[EXTENT_BY_LENGTH], extent, EXTENT_BY_LENGTH);
+    free(extent);
+}
+
+
+
+
+// Retorna a extensao livre de maior posicao que comeca no bloco de indice index ou antes dele, ou NULL se nao existir
+FreeExtent* __findExtentAtOrBefore(MountInfo *mount, unsigned int index)
+{
+    FreeExtent* node = mount->extentRoot[EXTENT_BY_OFFSET];
+    FreeExtent* found = NULL;
+
+    while(node != NULL)
+    {
+        if(node->start <= index)
+        {
+            found = node;
+            node = node->right[EXTENT_BY_OFFSET];
+        }
+        else node = node->left[EXTENT_BY_OFFSET];
+    }
+
+    return found;
+}
+
+
+
+
+// Retorna a extensao livre de menor posicao, entre as que comecam no bloco de indice from ou depois dele, com pelo
+// menos count blocos. O maior tamanho guardado em cada subarvore permite descartar subarvores inteiras. Retorna NULL
+// se nao existir
+FreeExtent* __findExtentFrom(FreeExtent *root, unsigned int from, unsigned int count)
+{
+    if(root == NULL || root->maxLength < count) return NULL;
+
+    if(root->start < from) return __findExtentFrom(root->right[EXTENT_BY_OFFSET], from, count);
+
+    FreeExtent* found = __findExtentFrom(root->left[EXTENT_BY_OFFSET], from, count);
+    if(found != NULL) return found;
+    if(root->length >= count) return root;
+
+    return __findExtentFrom(root->right[EXTENT_BY_OFFSET], from, count);
+}
+
+
+
+
+// Escolhe, pela politica de alocacao do contexto mount, a extensao livre de onde count blocos serao reservados, com
+// goalIndex como ponto de partida da politica NEXT_FIT. Se nenhuma extensao tiver count blocos, escolhe a maior.
+// O numero de blocos disponiveis na posicao escolhida, limitado a count, e escrito em *length. Retorna o indice do
+// primeiro bloco escolhido, com *length igual a 0 se nao houver bloco livre
+unsigned int __findFreeExtent(MountInfo *mount, unsigned int goalIndex, unsigned int count, unsigned int *length)
+{
+    FreeExtent* extent = NULL;
+    *length = 0;
+
+    if(mount->allocPolicy == MYFS_ALLOC_NEXT_FIT)
+    {
+        // A extensao que contem goalIndex e usada a partir dele, se tiver espaco suficiente
+        extent = __findExtentAtOrBefore(mount, goalIndex);
+        if(extent != NULL && extent->start + extent->length >= goalIndex + count)
+        {
+            *length = count;
+            return goalIndex;
+        }
+
+        extent = __findExtentFrom(mount->extentRoot[EXTENT_BY_OFFSET], goalIndex, count);
+        if(extent == NULL) extent = __findExtentFrom(mount->extentRoot[EXTENT_BY_OFFSET], 0, count);
+    }
+    else
+    {
+        // Menor extensao com pelo menos count blocos
+        FreeExtent* node = mount->extentRoot[EXTENT_BY_LENGTH];
+        while(node != NULL)
+        {
+            if(node->length >= count)
+            {
+                extent = node;
+                node = node->left[EXTENT_BY_LENGTH];
+            }
+            else node = node->right[EXTENT_BY_LENGTH];
+        }
+    }
+
+    if(extent == NULL)
+    {
+        // Nenhuma extensao e grande o suficiente, entao fica com a maior
+        extent = mount->extentRoot[EXTENT_BY_LENGTH];
+        while(extent != NULL && extent->right[EXTENT_BY_LENGTH] != NULL) extent = extent->right[EXTENT_BY_LENGTH];
+        if(extent == NULL) return 0;
+    }
+
+    *length = extent->length < count ? extent->length : count;
+    return extent->start;
+}
+
+
+
+
+// Garante que as arvores de extensoes livres do contexto mount estejam carregadas, construindo-as com uma leitura
+// sequencial do mapa de bits se necessario. Retorna true (!= 0) em caso de sucesso e false (0) caso contrario
+bool __loadFreeExtents(MountInfo *mount)
+{
+    if(mount->extentsLoaded) return true;
+
+    // Cada setor lido e incorporado como se tivesse acabado de ser escrito, emendando-se as extensoes ja inseridas
+    mount->extentsLoaded = true;
+    unsigned char buffer[DISK_SECTORDATASIZE];
+
+    unsigned int numSectors = (mount->numBlocks + BITS_PER_BITMAP_SECTOR - 1) / BITS_PER_BITMAP_SECTOR;
+    unsigned int i;
+    for(i=0; i < numSectors && mount->extentsLoaded; i++)
+    {
+        if(diskReadSector(mount->disk, mount->freeSpaceSector + i, buffer) == -1)
+        {
+            __invalidateFreeExtents(mount);
+            return false;
+        }
+
+        __updateFreeExtents(mount, i, buffer);
+    }
+
+    return mount->extentsLoaded;
+}
+
+
+
+
+// Substitui as extensoes livres da faixa de blocos representada pelo setor sectorIndex do mapa de bits pelas
+// sequencias de bits 0 de bitmapSector, emendando-as com as extensoes vizinhas. Nao faz nada se as arvores nao
+// estiverem carregadas
+void __updateFreeExtents(MountInfo *mount, unsigned int sectorIndex, const unsigned char *bitmapSector)
+{
+    if(!mount->extentsLoaded) return;
+
+    unsigned int low = sectorIndex * BITS_PER_BITMAP_SECTOR;
+    if(low >= mount->numBlocks) return;
+
+    unsigned int high = low + BITS_PER_BITMAP_SECTOR;
+    if(high > mount->numBlocks) high = mount->numBlocks;
+
+    // Remove as extensoes que se sobrepoem a faixa ou encostam nela, guardando as partes que ficam de fora
+    unsigned int leftStart = low, rightEnd = high;
+    FreeExtent* extent = __findExtentAtOrBefore(mount, high);
+    while(extent != NULL && extent->start + extent->length >= low)
+    {
+        if(extent->start < leftStart) leftStart = extent->start;
+        if(extent->start + extent->length > rightEnd) rightEnd = extent->start + extent->length;
+
+        __removeFreeExtent(mount, extent);
+        extent = __findExtentAtOrBefore(mount, high);
+    }
+
+    // As partes removidas fora de [low, high) sao inteiramente livres, entao a de antes entra como uma sequencia ja
+    // iniciada e a de depois emenda com a ultima sequencia da faixa
+    unsigned int runStart = leftStart, runLength = low - leftStart;
+    unsigned int index;
+    for(index = low; index < high; index++)
+    {
+        unsigned int bit = index - low;
+        if( ((bitmapSector[bit / 8] >> (bit % 8)) & 1) == 0 )
+        {
+            if(runLength == 0) runStart = index;
+            runLength++;
+            continue;
+        }
+
+        if(runLength > 0 && !__addFreeExtent(mount, runStart, runLength))
+        {
+            __invalidateFreeExtents(mount);
+            return;
+        }
+        runLength = 0;
+    }
+
+    if(rightEnd > high)
+    {
+        if(runLength == 0) runStart = high;
+        runLength += rightEnd - high;
+    }
+
+    if(runLength > 0 && !__addFreeExtent(mount, runStart, runLength)) __invalidateFreeExtents(mount);
+}
+
+
+
+
+// Libera as arvores de extensoes livres do contexto mount, forcando sua reconstrucao na proxima alocacao que as use
+void __invalidateFreeExtents(MountInfo *mount)
+{
+    // Percorre a arvore por posicao removendo sempre a raiz, o que mantem a arvore por tamanho consistente ate o fim
+    while(mount->extentRoot[EXTENT_BY_OFFSET] != NULL) __removeFreeExtent(mount, mount->extentRoot[EXTENT_BY_OFFSET]);
+
+    mount->extentRoot[EXTENT_BY_LENGTH] = NULL;
+    mount->extentsLoaded = false;
+}
+
+
+
+
+// Encontra um bloco livre no disco e o marca como ocupado se este estiver em formato myfs. Retorna 0 se nao houver
+// bloco livre ou se o disco nao estiver formatado corretamente
+unsigned int __findFreeBlock(Disk *d)
+{
+    unsigned int allocated;
+    return __findFreeBlocks(d, 0, 1, &allocated);
+}
+
+
+
+
+// Reserva count blocos livres e contiguos, procurando a partir do bloco goal e dando a volta no disco se necessario.
+// Se nao existir sequencia livre com count blocos, reserva a maior sequencia encontrada. Com as politicas NEXT_FIT e
+// BEST_FIT a sequencia e escolhida pelas arvores de extensoes livres. O numero de blocos reservados e escrito em
+// *allocated. Retorna o endereco do primeiro bloco reservado ou 0 se nao houver bloco livre ou se o disco nao
+// estiver formatado corretamente
+unsigned int __findFreeBlocks(Disk *d, unsigned int goal, unsigned int count, unsigned int *allocated)
+{
+    *allocated = 0;
+    if(count == 0) return 0;
+
+    MountInfo* mount = __getMountInfo(d);
+    if(mount == NULL) return 0;
+
+    unsigned int goalIndex = goal >= mount->firstBlockSector ? (goal - mount->firstBlockSector) / mount->sectorsPerBlock : 0;
+    if(goalIndex >= mount->numBlocks) goalIndex = 0;
+
+    if(mount->allocPolicy != MYFS_ALLOC_FIRST_FIT)
+    {
+        // Sem bloco objetivo, NEXT_FIT continua de onde a ultima alocacao parou
+        if(goal < mount->firstBlockSector) goalIndex = mount->nextFitIndex < mount->numBlocks ? mount->nextFitIndex : 0;
+
+        if(!__loadFreeExtents(mount)) return 0;
+
+        unsigned int length;
+        unsigned int start = __findFreeExtent(mount, goalIndex, count, &length);
+        if(length == 0 || !__markBlockRange(d, start, length, true)) return 0;
+
+        mount->nextFitIndex = start + length;
+        *allocated = length;
+        return mount->firstBlockSector + start * mount->sectorsPerBlock;
+    }
+
+    // Pelo resumo do mapa de bits, se nao existe sequencia livre com count blocos a busca pode parar ao encontrar a
+    // maior que existe, sem percorrer o resto do disco
+    if(!__loadFreeSpaceSummary(mount) || mount->freeSpace.totalFree == 0) return 0;
+
+    unsigned int largestRun = __getLargestFreeRun(d);
+    if(count > largestRun) count = largestRun;
+
+    FreeSpaceSummary* summary = &mount->freeSpace;
+    unsigned char buffer[DISK_SECTORDATASIZE];
+
+    unsigned int bestStart = 0, bestLength = 0;
+    unsigned int loadedSector = 0; // O setor 0 e o superbloco, entao nenhum setor do mapa de bits esta carregado
+
+    // A primeira passada vai de goal ate o fim da area de blocos e a segunda do inicio da area ate goal
+    int pass;
+    for(pass = 0; pass < 2 && bestLength < count; pass++)
+    {
+        unsigned int index = pass == 0 ? goalIndex : 0;
+        unsigned int end   = pass == 0 ? mount->numBlocks : goalIndex;
+        unsigned int runStart = index, runLength = 0;
+
+        while(index < end && bestLength < count)
+        {
+            // Setores do mapa de bits e palavras sem nenhum bloco livre sao pulados sem ler o disco
+            if(summary->sectorFree[index / BITS_PER_BITMAP_SECTOR] == 0)
+            {
+                runLength = 0;
+                index = (index / BITS_PER_BITMAP_SECTOR + 1) * BITS_PER_BITMAP_SECTOR;
+                continue;
+            }
+
+            unsigned int word = index / BITMAP_WORD_BITS;
+            if( ((summary->wordHasFree[word / 8] >> (word % 8)) & 1) == 0 )
+            {
+                runLength = 0;
+                index = (word + 1) * BITMAP_WORD_BITS;
+                continue;
+            }
+
+            unsigned int sector = mount->freeSpaceSector + index / BITS_PER_BITMAP_SECTOR;
+            if(sector != loadedSector)
+            {
+                if(diskReadSector(d, sector, buffer) == -1) return 0;
+                loadedSector = sector;
+            }
+
+            unsigned int byte = (index % BITS_PER_BITMAP_SECTOR) / 8;
+
+            // Byte sem nenhum bit 0 interrompe a sequencia atual, pula os 8 blocos de uma vez
+            if(index % 8 == 0 && __firstZeroBit(buffer[byte]) == -1)
+            {
+                runLength = 0;
+                index += 8;
+                continue;
+            }
+
+            if( (buffer[byte] >> (index % 8)) & 1 ) runLength = 0;
+            else
+            {
+                if(runLength == 0) runStart = index;
+                runLength++;
+
+                if(runLength > bestLength)
+                {
+                    bestStart = runStart;
+                    bestLength = runLength;
+                }
+            }
+
+            index++;
+        }
+    }
+
+    if(bestLength == 0) return 0; // Nenhum bloco livre
+    if(!__markBlockRange(d, bestStart, bestLength, true)) return 0;
+
+    *allocated = bestLength;
+    return mount->firstBlockSector + bestStart * mount->sectorsPerBlock;
+}
+
+
+
+
+// Dado um bloco em um disco formatado em myfs, marca o bloco como livre para uso. Retorna true (!= 0) se a operacao
+// foi bem sucedida e false (0) se algum erro ocorreu no processo
+bool __setBlockFree(Disk *d, unsigned int block)
+{
+    return __setBlocksFree(d, block, 1);
+}
+
+
+
+
+
+// Dado o primeiro de count blocos contiguos em um disco formatado em myfs, marca todos como livres para uso. Retorna
+// true (!= 0) se a operacao foi bem sucedida e false (0) se algum erro ocorreu no processo
+bool __setBlocksFree(Disk *d, unsigned int block, unsigned int count)
+{
+    MountInfo* mount = __getMountInfo(d);
+    if(mount == NULL) return false;
+
+    // Blocos de entrada excedem a regiao de blocos disponiveis
+    if(block < mount->firstBlockSector ||
+       (block - mount->firstBlockSector) / mount->sectorsPerBlock + count > mount->numBlocks) return false;
+
+    return __markBlockRange(d, (block - mount->firstBlockSector) / mount->sectorsPerBlock, count, false);
+}
+
+
+
+
+// Compara dois enderecos de bloco para qsort, em ordem crescente
+int __compareBlockAddr(const void *a, const void *b)
+{
+    unsigned int first = *(const unsigned int*) a;
+    unsigned int second = *(const unsigned int*) b;
+
+    return first < second ? -1 : first > second;
+}
+
+
+
+
+// Marca como livres os count blocos cujos enderecos estao em blocks, em qualquer ordem. Os enderecos sao ordenados no
+// proprio vetor e agrupados por setor do mapa de bits, de modo que cada setor envolvido e lido e escrito apenas uma
+// vez. Retorna true (!= 0) se a operacao foi bem sucedida e false (0) se algum erro ocorreu no processo
+bool __setBlockListFree(Disk *d, unsigned int *blocks, unsigned int count)
+{
+    if(count == 0) return true;
+
+    MountInfo* mount = __getMountInfo(d);
+    if(mount == NULL) return false;
+
+    unsigned int sectorsPerBlock = mount->sectorsPerBlock;
+    unsigned int numBlocks = mount->numBlocks;
+    unsigned int firstBlock = mount->firstBlockSector;
+    unsigned int freeSpaceSector = mount->freeSpaceSector;
+
+    unsigned char buffer[DISK_SECTORDATASIZE];
+
+    // Um bloco comprimido libera a sua referencia ao bloco do disco que guarda seus dados
+    unsigned int i;
+    for(i = 0; i < count; i++) blocks[i] = __getPhysicalBlock(d, blocks[i]);
+
+    qsort(blocks, count, sizeof(unsigned int), __compareBlockAddr);
+
+    // Enderecos anteriores a area de blocos ficam no inicio do vetor ordenado e sao ignorados
+    bool success = true;
+    i = 0;
+    while(i < count && blocks[i] < firstBlock)
+    {
+        if(blocks[i] != HOLE_BLOCK) success = false; // Buracos de arquivos esparsos nao ocupam blocos
+        i++;
+    }
+
+    // Blocos compartilhados com clones perdem apenas uma referencia e continuam em uso
+    unsigned int numUnshared = count - i;
+    if(!__dropBlockRefs(d, blocks + i, &numUnshared)) return false;
+    count = i + numUnshared;
+
+    __forgetDedupBlocks(mount, blocks + i, numUnshared);
+
+    while(i < count && (blocks[i] - firstBlock) / sectorsPerBlock < numBlocks)
+    {
+        unsigned int sectorIndex = (blocks[i] - firstBlock) / sectorsPerBlock / BITS_PER_BITMAP_SECTOR;
+        if(diskReadSector(d, freeSpaceSector + sectorIndex, buffer) == -1) return false;
+
+        // Libera todos os blocos da lista que pertencem ao setor carregado antes de escreve-lo de volta
+        do
+        {
+            unsigned int index = (blocks[i] - firstBlock) / sectorsPerBlock;
+            unsigned int bit = index % BITS_PER_BITMAP_SECTOR;
+            if( (buffer[bit / 8] >> (bit % 8)) & 1 ) __countGroupBlock(mount, index, false);
+
+            buffer[bit / 8] = __setBitToZero(buffer[bit / 8], bit % 8);
+            i++;
+        } while(i < count && (blocks[i] - firstBlock) / sectorsPerBlock < numBlocks &&
+                (blocks[i] - firstBlock) / sectorsPerBlock / BITS_PER_BITMAP_SECTOR == sectorIndex);
+
+        if(diskWriteSector(d, freeSpaceSector + sectorIndex, buffer) == -1)
+        {
+            __invalidateFreeSpaceSummary(mount);
+            __invalidateFreeExtents(mount);
+            return false;
+        }
+
+        __updateFreeSpaceSummary(mount, sectorIndex, buffer);
+        __updateFreeExtents(mount, sectorIndex, buffer);
+    }
+
+    // Enderecos alem da area de blocos ficam no fim do vetor ordenado
+    return success && i == count;
+}
+
+
+
+
+
+// Garante que a contagem de blocos compartilhados por setor da tabela de referencias do contexto mount esteja
+// alocada. Setores ainda nao lidos sao marcados como SHARED_COUNT_UNKNOWN. Retorna true (!= 0) em caso de sucesso e
+// false (0) caso contrario
+bool __loadSharedCounts(MountInfo *mount)
+{
+    if(mount->sectorShared != NULL) return true;
+
+    unsigned int numSectors = (mount->numBlocks + REFS_PER_SECTOR - 1) / REFS_PER_SECTOR;
+    mount->sectorShared = malloc((numSectors + 1) * sizeof(unsigned int));
+    if(mount->sectorShared == NULL) return false;
+
+    unsigned int i;
+    for(i = 0; i <= numSectors; i++) mount->sectorShared[i] = SHARED_COUNT_UNKNOWN;
+
+    return true;
+}
+
+
+
+
+// Le o setor sectorIndex da tabela de referencias do contexto mount em buffer, contando seus blocos compartilhados se
+// o setor ainda nao havia sido lido. Retorna true (!= 0) em caso de sucesso e false (0) caso contrario
+bool __readRefCountSector(MountInfo *mount, unsigned int sectorIndex, unsigned char *buffer)
+{
+    if(diskReadSector(mount->disk, mount->refCountSector + sectorIndex, buffer) == -1) return false;
+
+    if(mount->sectorShared[sectorIndex] == SHARED_COUNT_UNKNOWN)
+    {
+        unsigned int shared = 0;
+
+        unsigned int i;
+        for(i = 0; i < REFS_PER_SECTOR; i++)
+        {
+            unsigned int refs;
+            char2ul(&buffer[i * sizeof(unsigned int)], &refs);
+            if(refs > 0) shared++;
+        }
+
+        mount->sectorShared[sectorIndex] = shared;
+    }
+
+    return true;
+}
+
+
+
+
+// Retorna o numero de referencias ao bloco do disco que guarda o bloco block alem da primeira, ou 0 se o bloco nao e
+// compartilhado, se o disco nao possui tabela de referencias ou em caso de erro
+unsigned int __getBlockRefs(Disk *d, unsigned int block)
+{
+    MountInfo* mount = __getMountInfo(d);
+    block = __getPhysicalBlock(d, block);
+    if(mount == NULL || mount->refCountSector == 0 || block < mount->firstBlockSector) return 0;
+
+    unsigned int index = (block - mount->firstBlockSector) / mount->sectorsPerBlock;
+    if(index >= mount->numBlocks || !__loadSharedCounts(mount)) return 0;
+
+    // Setores sem blocos compartilhados, o caso comum, sao resolvidos sem acesso ao disco
+    if(mount->sectorShared[index / REFS_PER_SECTOR] == 0) return 0;
+
+    unsigned char buffer[DISK_SECTORDATASIZE];
+    if(!__readRefCountSector(mount, index / REFS_PER_SECTOR, buffer)) return 0;
+
+    unsigned int refs;
+    char2ul(&buffer[index % REFS_PER_SECTOR * sizeof(unsigned int)], &refs);
+    return refs;
+}
+
+
+
+
+// Acrescenta uma referencia a cada um dos count blocos cujos enderecos estao em blocks, ordenando o vetor e trocando
+// enderecos de blocos comprimidos pelos blocos do disco que guardam seus dados. Buracos de arquivos esparsos sao
+// ignorados. Cada setor da tabela de referencias envolvido e lido e escrito apenas uma vez. Retorna true (!= 0) em caso
+// de sucesso e false (0) se o disco nao possui tabela de referencias ou em caso de erro
+bool __addBlockRefs(Disk *d, unsigned int *blocks, unsigned int count)
+{
+    MountInfo* mount = __getMountInfo(d);
+    if(mount == NULL || mount->refCountSector == 0 || !__loadSharedCounts(mount)) return false;
+
+    unsigned int firstBlock = mount->firstBlockSector;
+    unsigned int sectorsPerBlock = mount->sectorsPerBlock;
+    unsigned char buffer[DISK_SECTORDATASIZE];
+
+    unsigned int i;
+    for(i = 0; i < count; i++) blocks[i] = __getPhysicalBlock(d, blocks[i]);
+
+    qsort(blocks, count, sizeof(unsigned int), __compareBlockAddr);
+
+    i = 0;
+    while(i < count && blocks[i] == HOLE_BLOCK) i++;
+
+    while(i < count)
+    {
+        if(blocks[i] < firstBlock || (blocks[i] - firstBlock) / sectorsPerBlock >= mount->numBlocks) return false;
+
+        unsigned int sectorIndex = (blocks[i] - firstBlock) / sectorsPerBlock / REFS_PER_SECTOR;
+        if(!__readRefCountSector(mount, sectorIndex, buffer)) return false;
+
+        // Todos os blocos da lista que pertencem ao setor carregado ganham a referencia antes que ele seja escrito
+        do
+        {
+            unsigned char* entry = &buffer[(blocks[i] - firstBlock) / sectorsPerBlock % REFS_PER_SECTOR *
+                                           sizeof(unsigned int)];
+            unsigned int refs;
+            char2ul(entry, &refs);
+
+            if(refs == 0) mount->sectorShared[sectorIndex]++;
+            ul2char(refs + 1, entry);
+            i++;
+        } while(i < count && (blocks[i] - firstBlock) / sectorsPerBlock < mount->numBlocks &&
+                (blocks[i] - firstBlock) / sectorsPerBlock / REFS_PER_SECTOR == sectorIndex);
+
+        if(diskWriteSector(d, mount->refCountSector + sectorIndex, buffer) == -1)
+        {
+            mount->sectorShared[sectorIndex] = SHARED_COUNT_UNKNOWN;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+
+
+// Retira uma referencia de cada bloco compartilhado do vetor ordenado de *count enderecos de blocks, todos da area de
+// blocos, removendo-o do vetor. Restam em blocks, na mesma ordem, os *count blocos sem outras referencias, que podem
+// ser liberados. Retorna true (!= 0) em caso de sucesso e false (0) caso contrario
+bool __dropBlockRefs(Disk *d, unsigned int *blocks, unsigned int *count)
+{
+    MountInfo* mount = __getMountInfo(d);
+    if(mount == NULL) return false;
+    if(mount->refCountSector == 0) return true;
+    if(!__loadSharedCounts(mount)) return false;
+
+    unsigned int firstBlock = mount->firstBlockSector;
+    unsigned int sectorsPerBlock = mount->sectorsPerBlock;
+    unsigned char buffer[DISK_SECTORDATASIZE];
+
+    unsigned int kept = 0;
+    unsigned int i = 0;
+    while(i < *count)
+    {
+        // Enderecos alem da area de blocos sao mantidos para que a liberacao os rejeite
+        if((blocks[i] - firstBlock) / sectorsPerBlock >= mount->numBlocks)
+        {
+            blocks[kept++] = blocks[i++];
+            continue;
+        }
+
+        unsigned int sectorIndex = (blocks[i] - firstBlock) / sectorsPerBlock / REFS_PER_SECTOR;
+        unsigned int sectorEnd = i;
+        while(sectorEnd < *count && (blocks[sectorEnd] - firstBlock) / sectorsPerBlock < mount->numBlocks &&
+              (blocks[sectorEnd] - firstBlock) / sectorsPerBlock / REFS_PER_SECTOR == sectorIndex) sectorEnd++;
+
+        // Sem blocos compartilhados no setor, todos os blocos podem ser liberados sem ler a tabela
+        bool modified = false;
+        if(mount->sectorShared[sectorIndex] != 0)
+        {
+            if(!__readRefCountSector(mount, sectorIndex, buffer)) return false;
+        }
+
+        for(; i < sectorEnd; i++)
+        {
+            unsigned int refs = 0;
+            unsigned char* entry = &buffer[(blocks[i] - firstBlock) / sectorsPerBlock % REFS_PER_SECTOR *
+                                           sizeof(unsigned int)];
+            if(mount->sectorShared[sectorIndex] != 0) char2ul(entry, &refs);
+
+            if(refs == 0)
+            {
+                blocks[kept++] = blocks[i];
+                continue;
+            }
+
+            ul2char(refs - 1, entry);
+            if(refs == 1) mount->sectorShared[sectorIndex]--;
+            modified = true;
+        }
+
+        if(modified && diskWriteSector(d, mount->refCountSector + sectorIndex, buffer) == -1)
+        {
+            mount->sectorShared[sectorIndex] = SHARED_COUNT_UNKNOWN;
+            return false;
+        }
+    }
+
+    *count = kept;
+    return true;
+}
+
+
+
+
+// Garante que os checksums da area de blocos do contexto mount estejam carregados, lendo em sequencia toda a area de
+// checksums se necessario. Se o superbloco marcar a area como desatualizada, os checksums sao descartados e os setores
+// deixam de ser verificados ate a proxima escrita. Retorna true (!= 0) em caso de sucesso e false (0) caso contrario
+bool __loadChecksums(MountInfo *mount)
+{
+    if(mount->checksums != NULL) return true;
+
+    unsigned int numSectors = (mount->numBlocks * mount->sectorsPerBlock + CHECKSUMS_PER_SECTOR - 1) /
+                              CHECKSUMS_PER_SECTOR;
+
+    unsigned int* checksums = malloc(numSectors * CHECKSUMS_PER_SECTOR * sizeof(unsigned int));
+    mount->checksumDirty = calloc(numSectors, sizeof(unsigned char));
+    if(checksums == NULL || mount->checksumDirty == NULL)
+    {
+        free(checksums);
+        free(mount->checksumDirty);
+        mount->checksumDirty = NULL;
+        return false;
+    }
+
+    unsigned char buffer[DISK_SECTORDATASIZE];
+    bool ioError = diskReadSector(mount->disk, 0, buffer) == -1;
+    bool stale = !ioError && buffer[SUPERBLOCK_CHECKSUMS_STALE] != 0;
+
+    unsigned int i;
+    for(i = 0; i < numSectors && !stale && !ioError; i++)
+    {
+        ioError = diskReadSector(mount->disk, mount->checksumSector + i, buffer) == -1;
+
+        unsigned int j;
+        for(j = 0; j < CHECKSUMS_PER_SECTOR; j++)
+            char2ul(&buffer[j * sizeof(unsigned int)], &checksums[i * CHECKSUMS_PER_SECTOR + j]);
+    }
+
+    if(ioError)
+    {
+        free(checksums);
+        free(mount->checksumDirty);
+        mount->checksumDirty = NULL;
+        return false;
+    }
+
+    // Checksums possivelmente antigos, deixados por uma parada sem myfsClose, sao zerados tambem no disco na proxima
+    // gravacao da area, que continua marcada como desatualizada ate la
+    if(stale)
+    {
+        memset(checksums, 0, numSectors * CHECKSUMS_PER_SECTOR * sizeof(unsigned int));
+        memset(mount->checksumDirty, true, numSectors);
+    }
+
+    mount->checksums = checksums;
+    mount->checksumsDirty = stale;
+    return true;
+}
+
+
+
+
+// Calcula o checksum de um setor de dados: o seu CRC32C com o bit menos significativo sempre 1, ja que 0 marca um
+// setor sem checksum
+unsigned int __sectorChecksum(const unsigned char *data)
+{
+    return __crc32c(data, DISK_SECTORDATASIZE) | 1;
+}
+
+
+
+
+// Le o setor sector do disco d em data, como diskReadSector, e verifica o checksum dos setores da area de blocos.
+// Retorna 0 em caso de sucesso e -1 se a leitura falhar ou o conteudo nao corresponder ao checksum guardado
+int __readBlockSector(Disk *d, unsigned int sector, unsigned char *data)
+{
+    if(diskReadSector(d, sector, data) == -1) return -1;
+
+    MountInfo* mount = __getMountInfo(d);
+    if(mount == NULL || mount->checksumSector == 0 || sector < mount->firstBlockSector ||
+       sector - mount->firstBlockSector >= mount->numBlocks * mount->sectorsPerBlock) return 0;
+
+    if(!__loadChecksums(mount)) return -1;
+
+    unsigned int expected = mount->checksums[sector - mount->firstBlockSector];
+    return expected == 0 || expected == __sectorChecksum(data) ? 0 : -1;
+}
+
+
+
+
+// Grava data no setor sector do disco d, como diskWriteSector, e atualiza em memoria o checksum dos setores da area de
+// blocos, que e gravado depois por __saveChecksums. A primeira alteracao ainda nao gravada marca antes a area de
+// checksums como desatualizada no superbloco. Retorna 0 em caso de sucesso e -1 caso contrario
+int __writeBlockSector(Disk *d, unsigned int sector, unsigned char *data)
+{
+    MountInfo* mount = __getMountInfo(d);
+    if(mount != NULL && mount->checksumSector != 0 && sector >= mount->firstBlockSector &&
+       sector - mount->firstBlockSector < mount->numBlocks * mount->sectorsPerBlock)
+    {
+        if(!__loadChecksums(mount)) return -1;
+
+        if(!mount->checksumsDirty && !__markChecksumsStale(d, true)) return -1;
+
+        unsigned int index = sector - mount->firstBlockSector;
+        mount->checksums[index] = __sectorChecksum(data);
+        mount->checksumDirty[index / CHECKSUMS_PER_SECTOR] = true;
+        mount->checksumsDirty = true;
+    }
+
+    return diskWriteSector(d, sector, data);
+}
+
+
+
+
+// Grava os setores modificados da area de checksums do disco d e volta a marca-la como em dia no superbloco. Retorna
+// true (!= 0) em caso de sucesso e false (0) caso contrario
+bool __saveChecksums(Disk *d)
+{
+    MountInfo* mount = __getMountInfo(d);
+    if(mount == NULL) return false;
+    if(!mount->checksumsDirty) return true;
+
+    unsigned int numSectors = (mount->numBlocks * mount->sectorsPerBlock + CHECKSUMS_PER_SECTOR - 1) /
+                              CHECKSUMS_PER_SECTOR;
+    unsigned char buffer[DISK_SECTORDATASIZE];
+
+    unsigned int i;
+    for(i = 0; i < numSectors; i++)
+    {
+        if(!mount->checksumDirty[i]) continue;
+
+        unsigned int j;
+        for(j = 0; j < CHECKSUMS_PER_SECTOR; j++)
+            ul2char(mount->checksums[i * CHECKSUMS_PER_SECTOR + j], &buffer[j * sizeof(unsigned int)]);
+
+        if(diskWriteSector(d, mount->checksumSector + i, buffer) == -1) return false;
+        mount->checksumDirty[i] = false;
+    }
+
+    if(!__markChecksumsStale(d, false)) return false;
+
+    mount->checksumsDirty = false;
+    return true;
+}
+
+
+
+
+// Marca no superbloco do disco d a area de checksums como desatualizada (stale = true), enquanto houver checksums
+// alterados apenas em memoria, ou como em dia (stale = false). Uma parada sem myfsClose deixa a marca, e a proxima
+// montagem descarta os checksums em vez de acusar erro nos setores alterados. Retorna true (!= 0) em caso de sucesso
+// e false (0) caso contrario
+bool __markChecksumsStale(Disk *d, bool stale)
+{
+    unsigned char superblock[DISK_SECTORDATASIZE];
+    if(diskReadSector(d, 0, superblock) == -1) return false;
+
+    superblock[SUPERBLOCK_CHECKSUMS_STALE] = stale ? 1 : 0;
+    return diskWriteSector(d, 0, superblock) != -1;
+}
+
+
+
+
+// Obtem do contexto do disco a divisao em grupos de cilindros, escrevendo o numero de grupos em *numGroups, o numero
+// de blocos por grupo em *blocksPerGroup e o numero de inodes por grupo em *inodesPerGroup. Discos formatados sem
+// grupos sao tratados como um unico grupo. Retorna true (!= 0) em caso de sucesso e false (0) caso contrario
+bool __getGroupLayout(Disk *d, unsigned int *numGroups, unsigned int *blocksPerGroup, unsigned int *inodesPerGroup)
+{
+    MountInfo* mount = __getMountInfo(d);
+    if(mount == NULL) return false;
+
+    *numGroups = mount->numGroups;
+    *blocksPerGroup = mount->blocksPerGroup;
+    *inodesPerGroup = mount->inodesPerGroup;
+
+    return *numGroups > 0;
+}
+
+
+
+
+
+// Retorna o endereco do primeiro bloco do grupo de cilindros ao qual pertence o inode de numero inumber, usado como
+// ponto de partida para a alocacao dos blocos do arquivo. Retorna 0 em caso de erro
+unsigned int __getGroupFirstBlock(Disk *d, unsigned int inumber)
+{
+    MountInfo* mount = __getMountInfo(d);
+    if(inumber == 0 || mount == NULL) return 0;
+
+    unsigned int group = (inumber - 1) / mount->inodesPerGroup;
+    if(group >= mount->numGroups) group = mount->numGroups - 1;
+
+    return mount->firstBlockSector + group * mount->blocksPerGroup * mount->sectorsPerBlock;
+}
+
+
+
+
+// Encontra um inode livre para um novo arquivo criado no diretorio de inode parentInumber. Arquivos comuns ficam no
+// grupo de cilindros do diretorio pai e novos diretorios vao para o grupo com mais blocos livres, espalhando-os pelo
+// disco. Se o grupo escolhido nao tiver inodes livres, procura nos demais. Retorna 0 se nao houver inode livre
+unsigned int __findFreeInode(Disk *d, unsigned int parentInumber, bool isDir)
+{
+    MountInfo* mount = __getMountInfo(d);
+    if(mount == NULL) return 0;
+
+    unsigned int numGroups = mount->numGroups;
+    unsigned int inodesPerGroup = mount->inodesPerGroup;
+    unsigned int numInodes = mount->numInodes;
+    unsigned int group = parentInumber > 0 ? (parentInumber - 1) / inodesPerGroup : 0;
+
+    if(isDir && numGroups > 1)
+    {
+        // O grupo mais vazio e escolhido pelas contagens de blocos livres do resumo do mapa de bits
+        if(!__loadFreeSpaceSummary(mount)) return 0;
+
+        unsigned int bestFree = 0;
+        unsigned int g;
+        for(g = 0; g < numGroups; g++)
+        {
+            if(mount->freeSpace.groupFree[g] > bestFree)
+            {
+                bestFree = mount->freeSpace.groupFree[g];
+                group = g;
+            }
+        }
+    }
+
+    if(group >= numGroups) group = numGroups - 1;
+
+    // inodeFindFreeInode nao conhece o fim da area de inodes, entao resultados alem dela sao descartados
+    unsigned int startFrom = group * inodesPerGroup + 1;
+    if(startFrom <= ROOT_DIRECTORY_INODE) startFrom = ROOT_DIRECTORY_INODE + 1;
+
+    unsigned int inumber = inodeFindFreeInode(startFrom, d);
+    if(inumber == 0 || inumber > numInodes) inumber = inodeFindFreeInode(ROOT_DIRECTORY_INODE + 1, d);
+    if(inumber > numInodes) return 0;
+
+    return inumber;
+}
+
+
+
+
+
+// Retorna o tamanho do bloco de um disco em bytes, assumindo que ele esteja formatado em myfs.
+// Retorna 0 em caso de erro
+unsigned int __getBlockSize(Disk *d)
+{
+    MountInfo* mount = __getMountInfo(d);
+    return mount == NULL ? 0 : mount->blockSize;
+}
+
+
+
+
+// Le diretamente do disco os itens do inode de numero inumber, seguindo o layout definido em inode.c. Usado para
+// percorrer extensoes de inodes, cujos enderecos alem do oitavo nao sao acessiveis pela API de inode.h. Retorna
+// true (!= 0) em caso de sucesso e false (0) caso contrario
+bool __readInodeItems(Disk *d, unsigned int inumber, unsigned int items[INODE_NUM_ITEMS])
+{
+    if(inumber == 0) return false;
+
+    unsigned char sector[DISK_SECTORDATASIZE];
+    unsigned int inodeSector = inodeAreaBeginSector() + (inumber - 1) / inodeNumInodesPerSector();
+    if(diskReadSector(d, inodeSector, sector) == -1) return false;
+
+    unsigned int offset = ((inumber - 1) % inodeNumInodesPerSector()) * INODE_NUM_ITEMS * sizeof(unsigned int);
+
+    int i;
+    for(i = 0; i < INODE_NUM_ITEMS; i++) char2ul(&sector[offset + i * sizeof(unsigned int)], &items[i]);
+
+    return true;
+}
+
+
+
+
+// Retorna o endereco do bloco de numero blockNum de um arquivo ou 0 se o arquivo nao possuir esse bloco. Ao
+// contrario de inodeGetBlockAddr, pode ser usada para blocos alem do fim da cadeia de extensoes do inode
+unsigned int __getBlockAddr(Disk *d, Inode *inode, unsigned int blockNum)
+{
+    if(blockNum < INODE_NUM_BLOCKS) return inodeGetBlockAddr(inode, blockNum);
+
+    unsigned int items[INODE_NUM_ITEMS];
+    unsigned int extNumber = inodeGetNextNumber(inode);
+    unsigned int extIndex;
+
+    blockNum -= INODE_NUM_BLOCKS;
+    for(extIndex = 0; extIndex <= blockNum / INODE_EXT_NUM_BLOCKS; extIndex++)
+    {
+        if(!__readInodeItems(d, extNumber, items)) return 0;
+        if(extIndex < blockNum / INODE_EXT_NUM_BLOCKS) extNumber = items[INODE_ITEM_NEXT];
+    }
+
+    return items[blockNum % INODE_EXT_NUM_BLOCKS];
+}
+
+
+
+
+// Escreve em blocks os enderecos dos count blocos de um arquivo a partir do bloco de numero firstBlock, percorrendo as
+// extensoes do inode uma unica vez. Blocos alem do fim do mapa recebem 0. Retorna true (!= 0) em caso de sucesso e
+// false (0) caso contrario
+bool __getBlockRange(Disk *d, Inode *inode, unsigned int firstBlock, unsigned int count, unsigned int *blocks)
+{
+    unsigned int i = 0;
+    for(; i < count && firstBlock + i < INODE_NUM_BLOCKS; i++) blocks[i] = inodeGetBlockAddr(inode, firstBlock + i);
+    if(i == count) return true;
+
+    unsigned int items[INODE_NUM_ITEMS];
+    unsigned int extNumber = inodeGetNextNumber(inode);
+    unsigned int extBlock = 0; // Numero, entre os blocos das extensoes, do primeiro bloco da extensao extNumber
+
+    while(i < count)
+    {
+        unsigned int blockNum = firstBlock + i - INODE_NUM_BLOCKS;
+
+        if(extNumber == 0)
+        {
+            for(; i < count; i++) blocks[i] = 0;
+            break;
+        }
+
+        if(!__readInodeItems(d, extNumber, items)) return false;
+
+        for(; i < count && blockNum < extBlock + INODE_EXT_NUM_BLOCKS; i++, blockNum++)
+        {
+            if(blockNum >= extBlock) blocks[i] = items[blockNum - extBlock];
+        }
+
+        extNumber = items[INODE_ITEM_NEXT];
+        extBlock += INODE_EXT_NUM_BLOCKS;
+    }
+
+    return true;
+}
+
+
+
+
+// Registra extNumber como a proxima extensao da cadeia de extensoes percorrida pelo descritor file. Retorna true
+// (!= 0) em caso de sucesso e false (0) se faltar memoria
+bool __addFileExtension(FileInfo *file, unsigned int extNumber)
+{
+    if(file->extChainLength == file->extChainCapacity)
+    {
+        unsigned int capacity = file->extChainCapacity == 0 ? 16 : 2 * file->extChainCapacity;
+        unsigned int* chain = realloc(file->extChain, capacity * sizeof(unsigned int));
+        if(chain == NULL) return false;
+
+        file->extChain = chain;
+        file->extChainCapacity = capacity;
+    }
+
+    file->extChain[file->extChainLength++] = extNumber;
+    return true;
+}
+
+
+
+
+// Le em items os itens da extensao de indice extIndex (0 para a primeira) do arquivo aberto file. Extensoes ja
+// percorridas pelo descritor sao lidas diretamente; as demais sao alcancadas a partir da ultima conhecida e
+// registradas. Se a cadeia terminar antes da extensao, items e zerado. Retorna true (!= 0) em caso de sucesso e false
+// (0) caso contrario
+bool __readFileExtension(FileInfo *file, unsigned int extIndex, unsigned int items[INODE_NUM_ITEMS])
+{
+    while(file->extChainLength <= extIndex)
+    {
+        unsigned int next = inodeGetNextNumber(file->inode);
+        if(file->extChainLength > 0)
+        {
+            if(!__readInodeItems(file->disk, file->extChain[file->extChainLength - 1], items)) return false;
+            next = items[INODE_ITEM_NEXT];
+        }
+
+        if(next == 0)
+        {
+            memset(items, 0, INODE_NUM_ITEMS * sizeof(unsigned int));
+            return true;
+        }
+
+        if(!__addFileExtension(file, next)) return false;
+    }
+
+    if(!__readInodeItems(file->disk, file->extChain[extIndex], items)) return false;
+
+    // A extensao seguinte a ultima conhecida ja fica registrada, sem nova leitura quando a busca continuar nela
+    if(extIndex == file->extChainLength - 1 && items[INODE_ITEM_NEXT] != 0)
+        return __addFileExtension(file, items[INODE_ITEM_NEXT]);
+
+    return true;
+}
+
+
+
+
+// Escreve em blocks os enderecos dos count blocos do arquivo aberto file a partir do bloco de numero firstBlock, como
+// __getBlockRange, mas lendo apenas as extensoes que guardam os blocos procurados quando o descritor ja as conhece.
+// Retorna true (!= 0) em caso de sucesso e false (0) caso contrario
+bool __getFileBlockRange(FileInfo *file, unsigned int firstBlock, unsigned int count, unsigned int *blocks)
+{
+    unsigned int i = 0;
+    for(; i < count && firstBlock + i < INODE_NUM_BLOCKS; i++)
+        blocks[i] = inodeGetBlockAddr(file->inode, firstBlock + i);
+
+    unsigned int items[INODE_NUM_ITEMS];
+    while(i < count)
+    {
+        unsigned int extIndex = (firstBlock + i - INODE_NUM_BLOCKS) / INODE_EXT_NUM_BLOCKS;
+        unsigned int extBlock = INODE_NUM_BLOCKS + extIndex * INODE_EXT_NUM_BLOCKS; // Primeiro bloco da extensao
+        if(!__readFileExtension(file, extIndex, items)) return false;
+
+        for(; i < count && firstBlock + i < extBlock + INODE_EXT_NUM_BLOCKS; i++)
+            blocks[i] = items[firstBlock + i - extBlock];
+    }
+
+    return true;
+}
+
+
+
+
+// Retorna o endereco do bloco de numero blockNum do arquivo aberto file, buscado como em __getFileBlockRange, ou 0 se
+// o arquivo nao possuir esse bloco ou em caso de erro
+unsigned int __getFileBlockAddr(FileInfo *file, unsigned int blockNum)
+{
+    unsigned int addr;
+    return __getFileBlockRange(file, blockNum, 1, &addr) ? addr : 0;
+}
+
+
+
+
+// Altera para addr o endereco do bloco de numero blockNum de um arquivo, gravando a extensao que o contem. So vale para
+// blocos guardados em extensoes, ja que os do inode principal sao mantidos pelo inode em memoria. Retorna true (!= 0)
+// em caso de sucesso e false (0) caso contrario
+bool __setBlockAddr(Disk *d, Inode *inode, unsigned int blockNum, unsigned int addr)
+{
+    if(blockNum < INODE_NUM_BLOCKS) return false;
+
+    unsigned int items[INODE_NUM_ITEMS];
+    unsigned int extNumber = inodeGetNextNumber(inode);
+    unsigned int extIndex;
+
+    blockNum -= INODE_NUM_BLOCKS;
+    for(extIndex = 0; extIndex <= blockNum / INODE_EXT_NUM_BLOCKS; extIndex++)
+    {
+        if(!__readInodeItems(d, extNumber, items)) return false;
+        if(extIndex < blockNum / INODE_EXT_NUM_BLOCKS) extNumber = items[INODE_ITEM_NEXT];
+    }
+
+    if(items[blockNum % INODE_EXT_NUM_BLOCKS] == 0) return false;
+
+    items[blockNum % INODE_EXT_NUM_BLOCKS] = addr;
+    return __writeInodeItems(d, extNumber, items);
+}
+
+
+
+
+// Retorna o endereco do bloco do disco d que guarda o endereco addr de um mapa de blocos: o proprio addr, ou, para um
+// bloco comprimido, o bloco que contem o primeiro setor dos seus dados. Retorna 0 em caso de erro
+unsigned int __getPhysicalBlock(Disk *d, unsigned int addr)
+{
+    if(!(addr & COMPRESSED_BLOCK_FLAG)) return addr;
+
+    MountInfo* mount = __getMountInfo(d);
+    unsigned int sector = addr & COMPRESSED_SECTOR_MASK;
+    if(mount == NULL || sector < mount->firstBlockSector) return 0;
+
+    return sector - (sector - mount->firstBlockSector) % mount->sectorsPerBlock;
+}
+
+
+
+
+// Grava diretamente no disco os itens do inode de numero inumber, seguindo o layout definido em inode.c. Retorna
+// true (!= 0) em caso de sucesso e false (0) caso contrario
+bool __writeInodeItems(Disk *d, unsigned int inumber, unsigned int items[INODE_NUM_ITEMS])
+{
+    if(inumber == 0) return false;
+
+    unsigned char sector[DISK_SECTORDATASIZE];
+    unsigned int inodeSector = inodeAreaBeginSector() + (inumber - 1) / inodeNumInodesPerSector();
+    if(diskReadSector(d, inodeSector, sector) == -1) return false;
+
+    unsigned int offset = ((inumber - 1) % inodeNumInodesPerSector()) * INODE_NUM_ITEMS * sizeof(unsigned int);
+
+    int i;
+    for(i = 0; i < INODE_NUM_ITEMS; i++) ul2char(items[i], &sector[offset + i * sizeof(unsigned int)]);
+
+    return diskWriteSector(d, inodeSector, sector) != -1;
+}
+
+
+
+
+// Limpa os count inodes de inumbers, que passam a ser considerados livres. Inodes do mesmo setor da area de inodes sao
+// limpos com uma unica leitura e escrita do setor. O vetor e ordenado no processo. Retorna true (!= 0) em caso de
+// sucesso e false (0) caso contrario
+bool __clearInodeList(Disk *d, unsigned int *inumbers, unsigned int count)
+{
+    qsort(inumbers, count, sizeof(unsigned int), __compareBlockAddr);
+
+    unsigned int inodesPerSector = inodeNumInodesPerSector();
+    unsigned char sector[DISK_SECTORDATASIZE];
+
+    unsigned int i = 0;
+    while(i < count)
+    {
+        unsigned int inodeSector = inodeAreaBeginSector() + (inumbers[i] - 1) / inodesPerSector;
+        if(diskReadSector(d, inodeSector, sector) == -1) return false;
+
+        // Todos os itens sao zerados, menos o numero do inode, usado por inodeFindFreeInode
+        for(; i < count && inodeAreaBeginSector() + (inumbers[i] - 1) / inodesPerSector == inodeSector; i++)
+        {
+            unsigned int offset = ((inumbers[i] - 1) % inodesPerSector) * INODE_NUM_ITEMS * sizeof(unsigned int);
+            memset(&sector[offset], 0, INODE_NUM_ITEMS * sizeof(unsigned int));
+            ul2char(inumbers[i], &sector[offset + INODE_ITEM_NUMBER * sizeof(unsigned int)]);
+        }
+
+        if(diskWriteSector(d, inodeSector, sector) == -1) return false;
+    }
+
+    return true;
+}
+
+
+
+
+
+// Retorna o numero de inodes do disco, assumindo que ele esteja formatado em myfs. Retorna 0 em caso de erro
+unsigned int __getNumInodes(Disk *d)
+{
+    MountInfo* mount = __getMountInfo(d);
+    return mount == NULL ? 0 : mount->numInodes;
+}
+
+
+
+
+// Le todo o mapa de blocos de um arquivo, percorrendo a cadeia de extensoes do inode uma unica vez. O numero de
+// blocos e escrito em *numBlocks. Retorna um vetor alocado dinamicamente com os enderecos dos blocos, que deve ser
+// liberado com free, ou NULL em caso de erro
+unsigned int* __loadBlockMap(Disk *d, Inode *inode, unsigned int *numBlocks)
+{
+    unsigned int capacity = INODE_NUM_BLOCKS;
+    unsigned int* blocks = malloc(capacity * sizeof(unsigned int));
+    if(blocks == NULL) return NULL;
+
+    *numBlocks = 0;
+    while(*numBlocks < INODE_NUM_BLOCKS && inodeGetBlockAddr(inode, *numBlocks) != 0)
+    {
+        blocks[*numBlocks] = inodeGetBlockAddr(inode, *numBlocks);
+        (*numBlocks)++;
+    }
+
+    unsigned int items[INODE_NUM_ITEMS];
+    unsigned int extNumber = *numBlocks == INODE_NUM_BLOCKS ? inodeGetNextNumber(inode) : 0;
+
+    while(extNumber != 0)
+    {
+        if(!__readInodeItems(d, extNumber, items))
+        {
+            free(blocks);
+            return NULL;
+        }
+
+        int i;
+        for(i = 0; i < INODE_EXT_NUM_BLOCKS && items[i] != 0; i++)
+        {
+            if(*numBlocks == capacity)
+            {
+                capacity *= 2;
+                unsigned int* newBlocks = realloc(blocks, capacity * sizeof(unsigned int));
+                if(newBlocks == NULL)
+                {
+                    free(blocks);
+                    return NULL;
+                }
+                blocks = newBlocks;
+            }
+
+            blocks[(*numBlocks)++] = items[i];
+        }
+
+        extNumber = items[INODE_ITEM_NEXT];
+    }
+
+    return blocks;
+}
+
+
+
+
+// Adiciona count enderecos de bloco ao fim do mapa de blocos de um arquivo. Enderecos que cabem em extensoes sao
+// gravados diretamente, com uma unica escrita por extensao, em vez de percorrer a cadeia a cada bloco como
+// inodeAddBlock. Retorna o numero de enderecos efetivamente adicionados
+unsigned int __appendBlocks(Disk *d, Inode *inode, const unsigned int *blocks, unsigned int count)
+{
+    unsigned int appended = 0;
+
+    // Enquanto o inode nao possui extensoes, inodeAddBlock preenche o inode principal e cria a primeira extensao
+    while(appended < count && inodeGetNextNumber(inode) == 0)
+    {
+        if(inodeAddBlock(inode, blocks[appended]) == -1) return appended;
+        appended++;
+    }
+
+    if(appended == count) return appended;
+
+    unsigned int items[INODE_NUM_ITEMS];
+    unsigned int extNumber = inodeGetNextNumber(inode);
+    if(!__readInodeItems(d, extNumber, items)) return appended;
+
+    while(items[INODE_ITEM_NEXT] != 0)
+    {
+        extNumber = items[INODE_ITEM_NEXT];
+        if(!__readInodeItems(d, extNumber, items)) return appended;
+    }
+
+    unsigned int numInodes = __getNumInodes(d);
+    unsigned int saved = appended; // Enderecos ja gravados em disco
+    unsigned int slot;
+    for(slot = 0; slot < INODE_EXT_NUM_BLOCKS && items[slot] != 0; slot++);
+
+    while(appended < count)
+    {
+        if(slot == INODE_EXT_NUM_BLOCKS) // Extensao cheia, encadeia uma nova
+        {
+            // A extensao atual ainda nao foi gravada e pareceria livre, entao a busca comeca na seguinte
+            unsigned int nextExtNumber = inodeFindFreeInode(extNumber + 1, d);
+            if(nextExtNumber == 0 || nextExtNumber > numInodes) break;
+
+            items[INODE_ITEM_NEXT] = nextExtNumber;
+            if(!__writeInodeItems(d, extNumber, items)) return saved;
+            saved = appended;
+
+            memset(items, 0, sizeof(items));
+            items[INODE_ITEM_NUMBER] = extNumber = nextExtNumber;
+            slot = 0;
+        }
+
+        items[slot++] = blocks[appended++];
+    }
+
+    return __writeInodeItems(d, extNumber, items) ? appended : saved;
+}
+
+
+
+
+// Reduz o mapa de blocos do arquivo de inode inode aos seus primeiros keepBlocks blocos (ao menos 1). Os blocos
+// descartados sao liberados com uma unica atualizacao do mapa de bits e as extensoes que ficam vazias sao limpas em
+// lote. Retorna true (!= 0) em caso de sucesso e false (0) caso contrario
+bool __truncateBlockMap(Disk *d, Inode *inode, unsigned int keepBlocks)
+{
+    if(keepBlocks == 0) keepBlocks = 1;
+
+    unsigned int numBlocks;
+    unsigned int* blocks = __loadBlockMap(d, inode, &numBlocks);
+    if(blocks == NULL) return false;
+
+    if(numBlocks <= keepBlocks)
+    {
+        free(blocks);
+        return true;
+    }
+
+    unsigned int* extensions = malloc((numBlocks / INODE_EXT_NUM_BLOCKS + 1) * sizeof(unsigned int));
+    if(extensions == NULL)
+    {
+        free(blocks);
+        return false;
+    }
+
+    // A extensao que guarda o ultimo bloco mantido e cortada ali; as seguintes sao descartadas inteiras
+    unsigned int items[INODE_NUM_ITEMS];
+    unsigned int numExtensions = 0;
+    unsigned int extNumber = inodeGetNextNumber(inode);
+    unsigned int firstEntry = INODE_NUM_BLOCKS; // Numero do primeiro bloco guardado na extensao atual
+    bool success = true;
+
+    while(extNumber != 0 && success)
+    {
+        if(!__readInodeItems(d, extNumber, items))
+        {
+            success = false;
+            break;
+        }
+
+        unsigned int nextExtNumber = items[INODE_ITEM_NEXT];
+
+        if(firstEntry >= keepBlocks) extensions[numExtensions++] = extNumber;
+        else if(firstEntry + INODE_EXT_NUM_BLOCKS >= keepBlocks)
+        {
+            unsigned int keptEntries = keepBlocks - firstEntry;
+            memset(&items[keptEntries], 0, (INODE_EXT_NUM_BLOCKS - keptEntries) * sizeof(unsigned int));
+            items[INODE_ITEM_NEXT] = 0;
+            success = __writeInodeItems(d, extNumber, items);
+        }
+
+        firstEntry += INODE_EXT_NUM_BLOCKS;
+        extNumber = nextExtNumber;
+    }
+
+    if(success) success = __clearInodeList(d, extensions, numExtensions);
+
+    // Os enderecos e a extensao do inode principal so podem ser removidos limpando o inode em memoria, que e entao
+    // reconstruido com seus atributos e os blocos mantidos
+    if(success && keepBlocks <= INODE_NUM_BLOCKS)
+    {
+        unsigned int fileType = inodeGetFileType(inode);
+        unsigned int fileSize = inodeGetFileSize(inode);
+        unsigned int owner = inodeGetOwner(inode);
+        unsigned int groupOwner = inodeGetGroupOwner(inode);
+        unsigned int permission = inodeGetPermission(inode);
+        unsigned int refCount = inodeGetRefCount(inode);
+
+        success = inodeClear(inode) == 0;
+
+        inodeSetFileType(inode, fileType);
+        inodeSetFileSize(inode, fileSize);
+        inodeSetOwner(inode, owner);
+        inodeSetGroupOwner(inode, groupOwner);
+        inodeSetPermission(inode, permission);
+        inodeSetRefCount(inode, refCount);
+
+        unsigned int i;
+        for(i = 0; i < keepBlocks && success; i++) success = inodeAddBlock(inode, blocks[i]) == 0;
+
+        if(inodeSave(inode) == -1) success = false;
+    }
+
+    // Os blocos so sao liberados se o mapa nao aponta mais para eles
+    if(success) success = __setBlockListFree(d, blocks + keepBlocks, numBlocks - keepBlocks);
+
+    free(extensions);
+    free(blocks);
+    return success;
+}
+
+
+
+
+// Reserva count blocos, preferencialmente contiguos e a partir do bloco goal, escrevendo seus enderecos em blocks.
+// Se nao houver uma unica sequencia livre grande o suficiente, usa as maiores sequencias disponiveis. Retorna o numero
+// de blocos reservados, menor que count apenas se o disco estiver cheio
+unsigned int __reserveBlocks(Disk *d, unsigned int goal, unsigned int count, unsigned int *blocks)
+{
+    unsigned int sectorsPerBlock = __getBlockSize(d) / DISK_SECTORDATASIZE;
+    unsigned int reserved = 0;
+
+    while(reserved < count)
+    {
+        unsigned int allocated;
+        unsigned int block = __findFreeBlocks(d, goal, count - reserved, &allocated);
+        if(block == 0) break;
+
+        unsigned int i;
+        for(i = 0; i < allocated; i++) blocks[reserved++] = block + i * sectorsPerBlock;
+
+        goal = block + allocated * sectorsPerBlock;
+    }
+
+    return reserved;
+}
+
+
+
+
+// Retorna o inode inumber do disco d em memoria, carregando-o do disco apenas se nenhum descritor ou operacao o estiver
+// usando. Quem o obtem deve devolve-lo com __releaseInode em vez de libera-lo com free. Se a tabela de inodes em
+// memoria estiver cheia, retorna uma copia propria, que nao e vista pelos demais usuarios. Retorna NULL em caso de erro
+Inode* __acquireInode(Disk *d, unsigned int inumber)
+{
+    OpenInode* freeSlot = NULL;
+
+    int i;
+    for(i=0; i < MAX_OPEN_INODES; i++)
+    {
+        if(openInodes[i].inode == NULL)
+        {
+            if(freeSlot == NULL) freeSlot = &openInodes[i];
+        }
+
+        else if(openInodes[i].disk == d && inodeGetNumber(openInodes[i].inode) == inumber)
+        {
+            openInodes[i].users++;
+            return openInodes[i].inode;
+        }
+    }
+
+    Inode* inode = inodeLoad(inumber, d);
+    if(inode == NULL || freeSlot == NULL) return inode;
+
+    freeSlot->inode = inode;
+    freeSlot->disk = d;
+    freeSlot->users = 1;
+
+    return inode;
+}
+
+
+
+
+// Devolve um inode obtido com __acquireInode, liberando sua memoria quando ele deixa de ser usado. Alteracoes devem ser
+// gravadas com inodeSave antes, pois o inode nao e salvo aqui
+void __releaseInode(Inode *inode)
+{
+    if(inode == NULL) return;
+
+    int i;
+    for(i=0; i < MAX_OPEN_INODES; i++)
+    {
+        if(openInodes[i].inode == inode)
+        {
+            if(--openInodes[i].users > 0) return;
+
+            openInodes[i].inode = NULL;
+            openInodes[i].disk = NULL;
+            break;
+        }
+    }
+
+    free(inode); // Ultimo usuario ou copia propria, fora da tabela
+}
+
+
+
+
+// Cria a estrutura de um arquivo aberto no disco d, com o cursor no inicio do arquivo e sem dados pendentes. Retorna
+// NULL se nao houver memoria suficiente
+FileInfo* __newFileInfo(Disk *d, unsigned int blockSize, Inode *inode)
+{
+    FileInfo* file = malloc(sizeof(FileInfo));
+    if(file == NULL) return NULL;
+
+    file->disk = d;
+    file->diskBlockSize = blockSize;
+    file->inode = inode;
+    file->currentByte = 0;
+
+    file->delayedData = NULL;
+    file->delayedStart = 0;
+    file->delayedSize = 0;
+    file->delayedCapacity = 0;
+
+    file->cacheData = NULL;
+    file->cacheBlock = 0;
+    file->cacheDirtyStart = 0;
+    file->cacheDirtyEnd = 0;
+
+    file->raData = NULL;
+    file->raBlocks = NULL;
+    file->raStart = 0;
+    file->raCount = 0;
+    file->raWindow = 0;
+    file->raNextByte = 0;
+
+    file->extChain = NULL;
+    file->extChainLength = 0;
+    file->extChainCapacity = 0;
+
+    file->generation = ++fileGeneration;
+
+    return file;
+}
+
+
+
+
+// Retorna o numero de blocos associados ao inode de acordo com o tamanho do arquivo. Todo arquivo possui ao menos um
+// bloco, reservado na sua criacao
+unsigned int __getNumFileBlocks(Inode *inode, unsigned int blockSize)
+{
+    unsigned int fileSize = inodeGetFileSize(inode);
+    return fileSize == 0 ? 1 : (fileSize + blockSize - 1) / blockSize;
+}
+
+
+
+
+// Retorna o tamanho do arquivo aberto file, contando os dados que ainda aguardam a alocacao atrasada
+unsigned int __getFileSize(FileInfo *file)
+{
+    unsigned int fileSize = inodeGetFileSize(file->inode);
+    if(file->delayedSize > 0 && file->delayedStart + file->delayedSize > fileSize)
+        fileSize = file->delayedStart + file->delayedSize;
+
+    return fileSize;
+}
+
+
+
+
+// Retorna o numero total de bytes dos iovcnt trechos de iov, ou -1 se o vetor for invalido ou o total nao couber no
+// retorno de myfsRead e myfsWrite
+long __getIovecLength(const struct iovec *iov, int iovcnt)
+{
+    if(iov == NULL || iovcnt < 0) return -1;
+
+    long total = 0;
+
+    int i;
+    for(i=0; i < iovcnt; i++)
+    {
+        if(iov[i].iov_len > (size_t) (INT_MAX - total)) return -1;
+        total += iov[i].iov_len;
+    }
+
+    return total;
+}
+
+
+
+
+// Grava no disco os setores modificados do bloco em cache do arquivo file, que continua em cache. Retorna true (!= 0)
+// em caso de sucesso e false (0) caso contrario
+bool __flushBlockCache(FileInfo *file)
+{
+    unsigned int i;
+    for(i = file->cacheDirtyStart; i < file->cacheDirtyEnd; i++)
+    {
+        if(__writeBlockSector(file->disk, file->cacheBlock + i, &file->cacheData[i * DISK_SECTORDATASIZE]) == -1)
+            return false;
+    }
+
+    file->cacheDirtyStart = file->cacheDirtyEnd = 0;
+    return true;
+}
+
+
+
+
+// Grava os setores modificados do bloco block no cache de qualquer outro arquivo aberto no mesmo disco de file e, se
+// drop for true, retira o bloco desses caches. Deve ser chamada antes de file acessar o bloco fora de seu proprio
+// cache (drop = false) ou de modifica-lo (drop = true), pois cada descritor possui seu cache. Retorna true (!= 0) em
+// caso de sucesso e false (0) caso contrario
+bool __syncBlockCaches(FileInfo *file, unsigned int block, bool drop)
+{
+    bool synced = true;
+
+    int i;
+    for(i=0; i < MAX_FDS; i++)
+    {
+        FileInfo* other = openFiles[i];
+        if(other == NULL || other == file || other->disk != file->disk || other->cacheBlock != block) continue;
+
+        if(!__flushBlockCache(other)) synced = false;
+        else if(drop) other->cacheBlock = 0;
+    }
+
+    return synced;
+}
+
+
+
+
+// Coloca no cache de file o bloco block, de numero blockNum no mapa de blocos do arquivo, gravando antes o bloco que
+// ocupava o cache. Blocos comprimidos sao descomprimidos, e setores alem do fim do arquivo sao zerados em vez de lidos.
+// forWrite indica que o bloco sera modificado. Retorna o conteudo do bloco em cache ou NULL em caso de erro
+unsigned char* __loadBlockCache(FileInfo *file, unsigned int blockNum, unsigned int block, bool forWrite)
+{
+    if(file->cacheBlock == block)
+    {
+        if(forWrite && !__syncBlockCaches(file, block, true)) return NULL;
+        return file->cacheData;
+    }
+
+    if(!__flushBlockCache(file)) return NULL;
+    file->cacheBlock = 0;
+
+    if(file->cacheData == NULL)
+    {
+        file->cacheData = malloc(file->diskBlockSize);
+        if(file->cacheData == NULL) return NULL;
+    }
+
+    // Outro descritor pode ter modificacoes do mesmo bloco ainda nao gravadas
+    if(!__syncBlockCaches(file, block, forWrite)) return NULL;
+
+    unsigned int fileSize = inodeGetFileSize(file->inode);
+    unsigned int sectorsPerBlock = file->diskBlockSize / DISK_SECTORDATASIZE;
+
+    // Um bloco comprimido e lido e descomprimido por inteiro
+    bool compressed = (block & COMPRESSED_BLOCK_FLAG) != 0;
+    if(compressed && !__readCompressedBlock(file->disk, block, file->diskBlockSize, file->cacheData)) return NULL;
+
+    unsigned int i;
+    for(i=0; i < sectorsPerBlock; i++)
+    {
+        unsigned char* sector = &file->cacheData[i * DISK_SECTORDATASIZE];
+
+        if(blockNum * file->diskBlockSize + i * DISK_SECTORDATASIZE >= fileSize)
+            memset(sector, 0, DISK_SECTORDATASIZE);
+
+        else if(!compressed && __readBlockSector(file->disk, block + i, sector) == -1) return NULL;
+    }
+
+    file->cacheBlock = block;
+    return file->cacheData;
+}
+
+
+
+
+// Coloca no cache de file o bloco block, recem associado ao arquivo, com todos os bytes zerados e marcados como
+// modificados, sem ler o disco. Retorna o conteudo do bloco em cache ou NULL em caso de erro
+unsigned char* __zeroBlockCache(FileInfo *file, unsigned int block)
+{
+    if(!__flushBlockCache(file)) return NULL;
+    file->cacheBlock = 0;
+
+    if(file->cacheData == NULL)
+    {
+        file->cacheData = malloc(file->diskBlockSize);
+        if(file->cacheData == NULL) return NULL;
+    }
+
+    memset(file->cacheData, 0, file->diskBlockSize);
+
+    file->cacheBlock = block;
+    file->cacheDirtyStart = 0;
+    file->cacheDirtyEnd = file->diskBlockSize / DISK_SECTORDATASIZE;
+
+    return file->cacheData;
+}
+
+
+
+
+// Coloca no cache de file o conteudo do bloco block, de numero blockNum no mapa de blocos do arquivo, como conteudo do
+// bloco newBlock, que o substitui no arquivo. Todos os bytes ficam marcados como modificados, de modo que a copia seja
+// gravada em newBlock. Retorna o conteudo do bloco em cache ou NULL em caso de erro
+unsigned char* __copyBlockCache(FileInfo *file, unsigned int blockNum, unsigned int block, unsigned int newBlock)
+{
+    unsigned char* cache = __loadBlockCache(file, blockNum, block, false);
+    if(cache == NULL) return NULL;
+
+    file->cacheBlock = newBlock;
+    file->cacheDirtyStart = 0;
+    file->cacheDirtyEnd = file->diskBlockSize / DISK_SECTORDATASIZE;
+
+    return cache;
+}
+
+
+
+
+// Descarta a leitura antecipada e a cadeia de extensoes conhecida de todos os descritores abertos do mesmo arquivo de
+// file, identificados pelo disco e pelo numero do inode, ja que um descritor pode usar uma copia propria do inode, e
+// renova suas geracoes, invalidando os mapeamentos feitos sobre eles. Deve ser chamada antes de qualquer alteracao no
+// conteudo ou no mapa de blocos do arquivo
+void __dropReadAhead(FileInfo *file)
+{
+    unsigned int inumber = inodeGetNumber(file->inode);
+
+    int i;
+    for(i=0; i < MAX_FDS; i++)
+    {
+        FileInfo* other = openFiles[i];
+        if(other == NULL || other->disk != file->disk || inodeGetNumber(other->inode) != inumber) continue;
+
+        other->raCount = 0;
+        other->extChainLength = 0;
+        other->generation = ++fileGeneration;
+    }
+}
+
+
+
+
+// Traz para a leitura antecipada de file os blocos do arquivo a partir do bloco de numero blockNum, ate a janela atual
+// ou o fim do arquivo. Os blocos sao lidos em ordem de endereco no disco; buracos e setores alem do fim do arquivo sao
+// zerados, e o bloco no cache do proprio arquivo e copiado dele. Retorna true (!= 0) em caso de sucesso e false (0)
+// caso contrario, em que a leitura antecipada fica vazia
+bool __fillReadAhead(FileInfo *file, unsigned int blockNum)
+{
+    unsigned int blockSize = file->diskBlockSize;
+    unsigned int fileSize = inodeGetFileSize(file->inode);
+    unsigned int fileBlocks = (fileSize + blockSize - 1) / blockSize;
+
+    file->raCount = 0;
+
+    unsigned int count = file->raWindow < READ_AHEAD_MAX_BLOCKS ? file->raWindow : READ_AHEAD_MAX_BLOCKS;
+    if(blockNum >= fileBlocks) return true;
+    if(count > fileBlocks - blockNum) count = fileBlocks - blockNum;
+
+    if(file->raData == NULL)
+    {
+        file->raData = malloc(READ_AHEAD_MAX_BLOCKS * blockSize);
+        file->raBlocks = malloc(READ_AHEAD_MAX_BLOCKS * sizeof(unsigned int));
+        if(file->raData == NULL || file->raBlocks == NULL)
+        {
+            free(file->raData);
+            free(file->raBlocks);
+            file->raData = NULL;
+            file->raBlocks = NULL;
+            return false;
+        }
+    }
+
+    unsigned int* blocks = file->raBlocks;
+    if(!__getFileBlockRange(file, blockNum, count, blocks)) return false;
+
+    // Ordena os blocos da janela por endereco, por insercao, ja que a janela e pequena
+    unsigned int order[READ_AHEAD_MAX_BLOCKS];
+    unsigned int i;
+    for(i = 0; i < count; i++)
+    {
+        unsigned int j = i;
+        while(j > 0 && __getPhysicalBlock(file->disk, blocks[order[j-1]]) > __getPhysicalBlock(file->disk, blocks[i]))
+        {
+            order[j] = order[j-1];
+            j--;
+        }
+        order[j] = i;
+    }
+
+    for(i = 0; i < count; i++)
+    {
+        unsigned int index = order[i];
+        unsigned int block = blocks[index];
+        unsigned char* data = &file->raData[index * blockSize];
+
+        if(block == 0) return false;
+
+        if(block == HOLE_BLOCK) memset(data, 0, blockSize);
+        else if(block == file->cacheBlock) memcpy(data, file->cacheData, blockSize);
+        else if(block & COMPRESSED_BLOCK_FLAG)
+        {
+            if(!__readCompressedBlock(file->disk, block, blockSize, data)) return false;
+        }
+        else
+        {
+            if(!__syncBlockCaches(file, block, false)) return false;
+
+            unsigned int sector;
+            for(sector = 0; sector < blockSize / DISK_SECTORDATASIZE; sector++)
+            {
+                unsigned char* sectorData = &data[sector * DISK_SECTORDATASIZE];
+
+                if((blockNum + index) * blockSize + sector * DISK_SECTORDATASIZE >= fileSize)
+                    memset(sectorData, 0, DISK_SECTORDATASIZE);
+
+                else if(__readBlockSector(file->disk, block + sector, sectorData) == -1) return false;
+            }
+        }
+    }
+
+    file->raStart = blockNum;
+    file->raCount = count;
+    return true;
+}
+
+
+
+
+// Escreve nbytes de buf nos blocos do arquivo, a partir de file->currentByte, alocando novos blocos contiguos quando
+// necessario. Trechos que nao cobrem setores inteiros passam pelo cache de bloco do arquivo. Avanca o cursor e atualiza
+// o tamanho do arquivo. Retorna o numero de bytes escritos ou -1 em caso de erro de leitura ou escrita no disco
+int __writeBlocks(FileInfo *file, const char *buf, unsigned int nbytes)
+{
+    __dropReadAhead(file);
+
+    unsigned int fileSize = inodeGetFileSize(file->inode);
+    unsigned int bytesWritten = 0;
+    unsigned int currentInodeBlockNum = file->currentByte / file->diskBlockSize;
+    unsigned int offset = file->currentByte % file->diskBlockSize; // offset em bytes a partir do início do bloco
+    unsigned int currentBlock = __getBlockAddr(file->disk, file->inode, currentInodeBlockNum);
+    unsigned int sectorsPerBlock = file->diskBlockSize / DISK_SECTORDATASIZE;
+
+    // Blocos reservados de uma so vez para o restante da escrita, mas ainda nao associados ao inode
+    unsigned int reservedBlock = 0;
+    unsigned int reservedCount = 0;
+    unsigned int previousBlock = 0;
+    bool mapEnded = false;
+    bool ioError = false;
+
+    while(bytesWritten < nbytes)
+    {
+        unsigned int firstSector = offset / DISK_SECTORDATASIZE;
+        unsigned int firstByteInSector = offset % DISK_SECTORDATASIZE;
+
+        if(currentBlock == 0)
+        {
+            if(reservedCount == 0)
+            {
+                // Procura uma sequencia contigua para todos os blocos que faltam, logo apos o ultimo bloco do arquivo
+                if(previousBlock == 0 && currentInodeBlockNum > 0)
+                    previousBlock = __getPhysicalBlock(file->disk,
+                                                       __getBlockAddr(file->disk, file->inode,
+                                                                      currentInodeBlockNum - 1));
+
+                unsigned int blocksNeeded = (offset + (nbytes - bytesWritten) + file->diskBlockSize - 1) /
+                                            file->diskBlockSize;
+                unsigned int goal = __getGroupFirstBlock(file->disk, inodeGetNumber(file->inode));
+                if(previousBlock > HOLE_BLOCK) goal = previousBlock + sectorsPerBlock;
+
+                reservedBlock = __findFreeBlocks(file->disk, goal, blocksNeeded, &reservedCount);
+
+                if(reservedBlock == 0) break; // Disco cheio
+            }
+
+            currentBlock = reservedBlock;
+            reservedBlock += sectorsPerBlock;
+            reservedCount--;
+            mapEnded = true;
+
+            if(inodeAddBlock(file->inode, currentBlock) == -1) // Erro na associacao do bloco livre ao inode
+            {
+                __setBlocksFree(file->disk, currentBlock, reservedCount + 1);
+                reservedCount = 0;
+                break;
+            }
+        }
+
+        unsigned int chunk = file->diskBlockSize - offset;
+        if(chunk > nbytes - bytesWritten) chunk = nbytes - bytesWritten;
+
+        // Um buraco de arquivo esparso recebe seu proprio bloco, que comeca zerado
+        bool filledHole = false;
+        if(currentBlock == HOLE_BLOCK)
+        {
+            if(previousBlock == 0 && currentInodeBlockNum > 0)
+                previousBlock = __getPhysicalBlock(file->disk,
+                                                   __getBlockAddr(file->disk, file->inode, currentInodeBlockNum - 1));
+
+            unsigned int goal = __getGroupFirstBlock(file->disk, inodeGetNumber(file->inode));
+            if(previousBlock > HOLE_BLOCK) goal = previousBlock + sectorsPerBlock;
+
+            unsigned int allocated;
+            unsigned int newBlock = __findFreeBlocks(file->disk, goal, 1, &allocated);
+            if(newBlock == 0) break; // Disco cheio
+
+            if(!__setBlockAddr(file->disk, file->inode, currentInodeBlockNum, newBlock))
+            {
+                __setBlockFree(file->disk, newBlock);
+                ioError = true;
+                break;
+            }
+
+            currentBlock = newBlock;
+            filledHole = true;
+        }
+
+        // Um bloco compartilhado com um clone, ou comprimido, e copiado para um bloco so deste arquivo antes de ser
+        // modificado. Apenas as extensoes do inode guardam esses blocos
+        if(currentBlock > HOLE_BLOCK && currentInodeBlockNum >= INODE_NUM_BLOCKS &&
+           ((currentBlock & COMPRESSED_BLOCK_FLAG) || __getBlockRefs(file->disk, currentBlock) > 0))
+        {
+            unsigned int goal = previousBlock > HOLE_BLOCK ? previousBlock + sectorsPerBlock :
+                                                             __getPhysicalBlock(file->disk, currentBlock);
+
+            unsigned int allocated;
+            unsigned int newBlock = __findFreeBlocks(file->disk, goal, 1, &allocated);
+            if(newBlock == 0) break; // Disco cheio
+
+            // A copia do conteudo anterior so e necessaria se o bloco nao for inteiramente sobrescrito
+            if( (chunk < file->diskBlockSize && __copyBlockCache(file, currentInodeBlockNum, currentBlock,
+                                                                 newBlock) == NULL) ||
+                !__setBlockAddr(file->disk, file->inode, currentInodeBlockNum, newBlock) )
+            {
+                if(file->cacheBlock == newBlock) file->cacheBlock = file->cacheDirtyStart = file->cacheDirtyEnd = 0;
+                __setBlockFree(file->disk, newBlock);
+                ioError = true;
+                break;
+            }
+
+            // O bloco original continua com os demais arquivos, e outros descritores deste arquivo deixam de usa-lo
+            unsigned int sharedBlock = currentBlock;
+            if(file->cacheBlock == sharedBlock) file->cacheBlock = 0;
+            if(!__syncBlockCaches(file, sharedBlock, true) || !__setBlockListFree(file->disk, &sharedBlock, 1))
+            {
+                ioError = true;
+                break;
+            }
+
+            currentBlock = newBlock;
+        }
+
+        // Trechos que nao cobrem setores inteiros, ou de um bloco ja em cache, sao escritos no cache do arquivo e
+        // gravados depois. Setores inteiramente sobrescritos sao gravados direto de buf, sem leitura previa
+        if(currentBlock == file->cacheBlock || firstByteInSector != 0 || (offset + chunk) % DISK_SECTORDATASIZE != 0 ||
+           (filledHole && chunk < file->diskBlockSize))
+        {
+            unsigned char* cache = filledHole ? __zeroBlockCache(file, currentBlock) :
+                                                __loadBlockCache(file, currentInodeBlockNum, currentBlock, true);
+            if(cache == NULL)
+            {
+                ioError = true;
+                break;
+            }
+
+            memcpy(&cache[offset], &buf[bytesWritten], chunk);
+
+            unsigned int dirtyEnd = (offset + chunk + DISK_SECTORDATASIZE - 1) / DISK_SECTORDATASIZE;
+            if(file->cacheDirtyEnd == 0 || firstSector < file->cacheDirtyStart) file->cacheDirtyStart = firstSector;
+            if(dirtyEnd > file->cacheDirtyEnd) file->cacheDirtyEnd = dirtyEnd;
+        }
+        else
+        {
+            if(!__syncBlockCaches(file, currentBlock, true))
+            {
+                ioError = true;
+                break;
+            }
+
+            unsigned int i;
+            for(i = 0; i < chunk / DISK_SECTORDATASIZE; i++)
+            {
+                const char* sector = &buf[bytesWritten + i * DISK_SECTORDATASIZE];
+                if(__writeBlockSector(file->disk, currentBlock + firstSector + i, (unsigned char*) sector) == -1)
+                {
+                    ioError = true;
+                    break;
+                }
+            }
+
+            if(ioError) break;
+        }
+
+        bytesWritten += chunk;
+
+        offset = 0;
+        currentInodeBlockNum++;
+        previousBlock = currentBlock;
+
+        // Depois do ultimo bloco associado ao inode nao ha mais o que consultar
+        currentBlock = mapEnded ? 0 : __getBlockAddr(file->disk, file->inode, currentInodeBlockNum);
+    }
+
+    // Blocos reservados que nao chegaram a ser usados voltam a ficar livres
+    if(reservedCount > 0) __setBlocksFree(file->disk, reservedBlock, reservedCount);
+    if(ioError) return -1;
+
+    file->currentByte += bytesWritten;
+    if(file->currentByte >= fileSize)
+    {
+        inodeSetFileSize(file->inode, file->currentByte);
+        inodeSave(file->inode);
+    }
+
+    return bytesWritten;
+}
+
+
+
+
+// Copia nbytes de buf para o buffer de alocacao atrasada do arquivo, a partir de file->currentByte. Se o limite
+// DELAYED_ALLOCATION_LIMIT ja tiver sido atingido, os dados pendentes sao gravados e nada e copiado. Retorna o numero
+// de bytes copiados ou -1 em caso de erro
+int __writeDelayed(FileInfo *file, const char *buf, unsigned int nbytes)
+{
+    if(file->delayedSize == 0) file->delayedStart = file->currentByte;
+
+    unsigned int position = file->currentByte - file->delayedStart;
+    if(position >= DELAYED_ALLOCATION_LIMIT)
+    {
+        // Buffer cheio: aloca os blocos pendentes e deixa o restante da escrita para a proxima chamada
+        return __flushDelayedData(file) ? 0 : -1;
+    }
+
+    if(nbytes > DELAYED_ALLOCATION_LIMIT - position) nbytes = DELAYED_ALLOCATION_LIMIT - position;
+
+    if(position + nbytes > file->delayedCapacity)
+    {
+        // Cresce o buffer em potencias de 2 ate o limite, evitando realocacoes a cada pequena escrita
+        unsigned int newCapacity = file->delayedCapacity > 0 ? file->delayedCapacity : file->diskBlockSize;
+        while(newCapacity < position + nbytes) newCapacity *= 2;
+        if(newCapacity > DELAYED_ALLOCATION_LIMIT) newCapacity = DELAYED_ALLOCATION_LIMIT;
+
+        char* newData = realloc(file->delayedData, newCapacity);
+        if(newData == NULL) return -1;
+
+        file->delayedData = newData;
+        file->delayedCapacity = newCapacity;
+    }
+
+    memcpy(&file->delayedData[position], buf, nbytes);
+
+    file->currentByte += nbytes;
+    if(position + nbytes > file->delayedSize) file->delayedSize = position + nbytes;
+
+    return nbytes;
+}
+
+
+
+
+// Calcula o hash de 64 bits dos size bytes de data, com size multiplo de 8, usado pelo indice de deduplicacao. Le os
+// dados 8 bytes por vez, de modo que o custo por bloco e pequeno perto de sua gravacao
+unsigned long long __hashBlock(const unsigned char *data, unsigned int size)
+{
+    unsigned long long hash = 0x9E3779B97F4A7C15ull ^ size;
+
+    unsigned int i;
+    for(i = 0; i + sizeof(unsigned long long) <= size; i += sizeof(unsigned long long))
+    {
+        unsigned long long word;
+        memcpy(&word, &data[i], sizeof(unsigned long long));
+
+        hash = (hash ^ word) * 0xFF51AFD7ED558CCDull;
+        hash ^= hash >> 32;
+    }
+
+    return hash;
+}
+
+
+
+
+// Verifica se o bloco block do indice de deduplicacao, comprimido ou nao, ainda tem o conteudo data. O bloco pode ter
+// sido modificado depois de indexado, entao ele e lido, apos a gravacao de alteracoes pendentes nos caches, e
+// comparado byte a byte. buffer deve ter o tamanho de um bloco. Retorna true (!= 0) se o conteudo for igual e false (0)
+// se for diferente ou ocorrer algum erro
+bool __matchDedupBlock(FileInfo *file, unsigned int block, const unsigned char *data, unsigned char *buffer)
+{
+    unsigned int blockSize = file->diskBlockSize;
+
+    if(block & COMPRESSED_BLOCK_FLAG)
+    {
+        if(!__readCompressedBlock(file->disk, block, blockSize, buffer)) return false;
+    }
+    else
+    {
+        if(file->cacheBlock == block && !__flushBlockCache(file)) return false;
+        if(!__syncBlockCaches(file, block, false)) return false;
+
+        unsigned int sector;
+        for(sector = 0; sector < blockSize / DISK_SECTORDATASIZE; sector++)
+        {
+            if(__readBlockSector(file->disk, block + sector, &buffer[sector * DISK_SECTORDATASIZE]) == -1) return false;
+        }
+    }
+
+    return memcmp(buffer, data, blockSize) == 0;
+}
+
+
+
+
+// Retira do indice de deduplicacao do contexto mount as entradas cujos dados estao em algum dos count blocos do vetor
+// ordenado blocks, que estao sendo liberados
+void __forgetDedupBlocks(MountInfo *mount, const unsigned int *blocks, unsigned int count)
+{
+    if(mount->dedupIndex == NULL || count == 0) return;
+
+    unsigned int i;
+    for(i = 0; i < DEDUP_INDEX_SIZE; i++)
+    {
+        DedupEntry* entry = &mount->dedupIndex[i];
+        if(entry->block == 0) continue;
+
+        unsigned int block = __getPhysicalBlock(mount->disk, entry->block);
+        if(bsearch(&block, blocks, count, sizeof(unsigned int), __compareBlockAddr) != NULL) entry->block = 0;
+    }
+}
+
+
+
+
+// Acrescenta ao indice de deduplicacao do contexto mount o bloco block, de hash hash. O bloco ocupa uma entrada vazia
+// ou com o mesmo hash do seu conjunto, ou, na falta delas, substitui uma entrada escolhida pelo proprio hash
+void __indexDedupBlock(MountInfo *mount, unsigned long long hash, unsigned int block)
+{
+    DedupEntry* set = &mount->dedupIndex[hash % (DEDUP_INDEX_SIZE / DEDUP_INDEX_WAYS) * DEDUP_INDEX_WAYS];
+
+    unsigned int way = (unsigned int) (hash >> 32) % DEDUP_INDEX_WAYS;
+    unsigned int i;
+    for(i = 0; i < DEDUP_INDEX_WAYS; i++)
+    {
+        if(set[i].block == 0 || set[i].hash == hash)
+        {
+            way = i;
+            break;
+        }
+    }
+
+    set[way].hash = hash;
+    set[way].block = block;
+}
+
+
+
+
+// Grava os dados pendentes de alocacao atrasada do arquivo, escrevendo em entries o endereco de cada bloco para o mapa
+// de blocos, a partir do objetivo goal. Os blocos das extensoes do inode sao deduplicados e comprimidos conforme o modo
+// do disco; os do inode principal sao sempre gravados como estao. Um bloco igual a outro dos dados pendentes ou a um
+// bloco do indice de deduplicacao passa a compartilha-lo. Blocos que nao economizam ao menos um setor sao gravados sem
+// compressao, e os comprimidos sao agrupados em sequencia nos mesmos blocos do disco. Cada endereco alem do primeiro
+// que aponta para um bloco do disco acrescenta uma referencia a ele. Retorna o numero de enderecos escritos em entries,
+// menor que o numero de blocos pendentes se faltar espaco em disco, ou 0 em caso de erro
+unsigned int __writePackedData(FileInfo *file, unsigned int goal, unsigned int *entries)
+{
+    MountInfo* mount = __getMountInfo(file->disk);
+    if(mount == NULL) return 0;
+
+    unsigned int blockSize = file->diskBlockSize;
+    unsigned int sectorsPerBlock = blockSize / DISK_SECTORDATASIZE;
+    unsigned int numBlocks = (file->delayedSize + blockSize - 1) / blockSize;
+    unsigned int firstBlockNum = file->delayedStart / blockSize;
+    unsigned int firstExtension = firstBlockNum < INODE_NUM_BLOCKS ? INODE_NUM_BLOCKS - firstBlockNum : 0;
+    bool dedup = mount->dedupIndex != NULL;
+
+    // Dados comprimidos so sao guardados se ocuparem menos setores que o bloco e couberem no endereco comprimido
+    unsigned int maxSectors = sectorsPerBlock - 1;
+    if(maxSectors > COMPRESSED_MAX_SECTORS) maxSectors = COMPRESSED_MAX_SECTORS;
+    if(!mount->compression) maxSectors = 0;
+
+    unsigned int* physIndex = malloc(numBlocks * sizeof(unsigned int));     // Bloco do disco de cada bloco do arquivo
+    unsigned int* firstSector = malloc(numBlocks * sizeof(unsigned int));   // Setor, no bloco do disco, dos seus dados
+    unsigned int* numSectors = malloc(numBlocks * sizeof(unsigned int));    // Setores comprimidos, 0 se sem compressao
+    unsigned int* sharedBlock = calloc(numBlocks, sizeof(unsigned int));    // Bloco do indice usado, 0 se nenhum
+    unsigned long long* hashes = malloc(numBlocks * sizeof(unsigned long long));
+    unsigned int* physical = malloc(numBlocks * sizeof(unsigned int));
+    unsigned int* usedSectors = malloc(numBlocks * sizeof(unsigned int));
+    unsigned int* physUsers = calloc(numBlocks, sizeof(unsigned int));
+    unsigned int* refs = malloc(numBlocks * sizeof(unsigned int));
+    unsigned char* image = malloc(numBlocks * blockSize);                   // Conteudo de cada bloco do disco
+    unsigned char* source = malloc(blockSize);
+    unsigned char* compressed = malloc(blockSize);
+
+    unsigned int count = 0;
+
+    if(physIndex != NULL && firstSector != NULL && numSectors != NULL && sharedBlock != NULL && hashes != NULL &&
+       physical != NULL && usedSectors != NULL && physUsers != NULL && refs != NULL && image != NULL &&
+       source != NULL && compressed != NULL)
+    {
+        // Monta em image o conteudo dos blocos do disco, na ordem em que os blocos do arquivo passam a usa-los
+        unsigned int numPhysical = 0;
+        unsigned int packBlock = 0;
+        bool packOpen = false;
+        bool success = true;
+
+        unsigned int i;
+        for(i = 0; i < numBlocks; i++)
+        {
+            // O ultimo bloco e completado com zeros
+            unsigned int length = file->delayedSize - i * blockSize < blockSize ? file->delayedSize - i * blockSize :
+                                                                                 blockSize;
+            memset(source, 0, blockSize);
+            memcpy(source, &file->delayedData[i * blockSize], length);
+
+            if(dedup && i >= firstExtension)
+            {
+                hashes[i] = __hashBlock(source, blockSize);
+
+                // Um bloco repetido nos dados pendentes usa o mesmo destino da sua primeira ocorrencia, que nunca e o
+                // ultimo bloco e por isso esta inteiro em delayedData
+                unsigned int j;
+                for(j = firstExtension; j < i; j++)
+                {
+                    if(hashes[j] == hashes[i] && memcmp(&file->delayedData[j * blockSize], source, blockSize) == 0)
+                        break;
+                }
+
+                if(j < i)
+                {
+                    physIndex[i] = physIndex[j];
+                    firstSector[i] = firstSector[j];
+                    numSectors[i] = numSectors[j];
+                    sharedBlock[i] = sharedBlock[j];
+                    continue;
+                }
+
+                DedupEntry* indexed = &mount->dedupIndex[hashes[i] % (DEDUP_INDEX_SIZE / DEDUP_INDEX_WAYS) *
+                                                         DEDUP_INDEX_WAYS];
+                for(j = 0; j < DEDUP_INDEX_WAYS && sharedBlock[i] == 0; j++)
+                {
+                    if(indexed[j].block != 0 && indexed[j].hash == hashes[i] &&
+                       __matchDedupBlock(file, indexed[j].block, source, compressed)) sharedBlock[i] = indexed[j].block;
+                }
+
+                if(sharedBlock[i] != 0) continue;
+            }
+
+            unsigned int size = 0;
+            if(i >= firstExtension && maxSectors > 0)
+                size = __compressBlock(source, blockSize, compressed, maxSectors * DISK_SECTORDATASIZE);
+
+            numSectors[i] = (size + DISK_SECTORDATASIZE - 1) / DISK_SECTORDATASIZE;
+
+            if(numSectors[i] == 0)
+            {
+                physIndex[i] = numPhysical;
+                firstSector[i] = 0;
+                usedSectors[numPhysical] = sectorsPerBlock;
+                memcpy(&image[numPhysical++ * blockSize], source, blockSize);
+                continue;
+            }
+
+            if(!packOpen || usedSectors[packBlock] + numSectors[i] > sectorsPerBlock)
+            {
+                packBlock = numPhysical++;
+                packOpen = true;
+                usedSectors[packBlock] = 0;
+                memset(&image[packBlock * blockSize], 0, blockSize);
+            }
+
+            physIndex[i] = packBlock;
+            firstSector[i] = usedSectors[packBlock];
+            memcpy(&image[packBlock * blockSize + firstSector[i] * DISK_SECTORDATASIZE], compressed, size);
+            usedSectors[packBlock] += numSectors[i];
+        }
+
+        // Se o disco estiver cheio, grava apenas os blocos do arquivo cujos dados couberem
+        unsigned int reserved = __reserveBlocks(file->disk, goal, numPhysical, physical);
+        while(count < numBlocks && (sharedBlock[count] != 0 || physIndex[count] < reserved)) count++;
+
+        unsigned int sector;
+        for(sector = 0; sector < reserved * sectorsPerBlock && success; sector++)
+        {
+            if(sector % sectorsPerBlock >= usedSectors[sector / sectorsPerBlock]) continue;
+
+            success = __writeBlockSector(file->disk, physical[sector / sectorsPerBlock] + sector % sectorsPerBlock,
+                                         &image[sector * DISK_SECTORDATASIZE]) != -1;
+        }
+
+        unsigned int numRefs = 0;
+        for(i = 0; i < count; i++)
+        {
+            if(sharedBlock[i] != 0)
+                entries[i] = sharedBlock[i];
+            else if(numSectors[i] == 0)
+                entries[i] = physical[physIndex[i]];
+            else
+                entries[i] = COMPRESSED_BLOCK_FLAG | (numSectors[i] << COMPRESSED_SECTORS_SHIFT) |
+                             (physical[physIndex[i]] + firstSector[i]);
+
+            if(sharedBlock[i] != 0 || physUsers[physIndex[i]]++ > 0) refs[numRefs++] = entries[i];
+        }
+
+        if(success && numRefs > 0) success = __addBlockRefs(file->disk, refs, numRefs);
+
+        if(!success)
+        {
+            __setBlockListFree(file->disk, physical, reserved);
+            count = 0;
+        }
+
+        // Os blocos gravados das extensoes passam a ser encontrados pelas proximas gravacoes
+        for(i = firstExtension; dedup && i < count; i++)
+        {
+            if(sharedBlock[i] == 0) __indexDedupBlock(mount, hashes[i], entries[i]);
+        }
+    }
+
+    free(physIndex);
+    free(firstSector);
+    free(numSectors);
+    free(sharedBlock);
+    free(hashes);
+    free(physical);
+    free(usedSectors);
+    free(physUsers);
+    free(refs);
+    free(image);
+    free(source);
+    free(compressed);
+
+    return count;
+}
+
+
+
+
+// Aloca de uma so vez os blocos necessarios para os dados pendentes de alocacao atrasada do arquivo, grava esses
+// dados e atualiza o tamanho do arquivo. Retorna true (!= 0) em caso de sucesso e false (0) se faltar espaco em disco
+// ou ocorrer algum erro, caso em que os dados que nao couberam sao descartados
+bool __flushDelayedData(FileInfo *file)
+{
+    if(file->delayedSize == 0) return true;
+
+    __dropReadAhead(file);
+
+    // Se o tamanho do arquivo mudou desde o inicio da alocacao atrasada, o fim do mapa de blocos nao corresponde mais a
+    // delayedStart, e os dados sao gravados como uma escrita comum na sua posicao
+    unsigned int fileSize = inodeGetFileSize(file->inode);
+    if(fileSize > file->delayedStart ||
+       __getNumFileBlocks(file->inode, file->diskBlockSize) < file->delayedStart / file->diskBlockSize)
+    {
+        char* data = file->delayedData;
+        unsigned int size = file->delayedSize;
+        unsigned int start = file->delayedStart;
+        unsigned int previousCurrentByte = file->currentByte;
+
+        file->delayedData = NULL;
+        file->delayedSize = 0;
+        file->delayedCapacity = 0;
+
+        int written = -1;
+        if(start <= fileSize || __extendFile(file, start))
+        {
+            file->currentByte = start;
+            written = __writeBlocks(file, data, size);
+            file->currentByte = previousCurrentByte;
+        }
+
+        free(data);
+        return written != -1 && (unsigned int) written == size;
+    }
+
+    unsigned int sectorsPerBlock = file->diskBlockSize / DISK_SECTORDATASIZE;
+    unsigned int blocksNeeded = (file->delayedSize + file->diskBlockSize - 1) / file->diskBlockSize;
+    unsigned char diskBuffer[DISK_SECTORDATASIZE];
+
+    unsigned int* blocks = malloc(blocksNeeded * sizeof(unsigned int));
+    if(blocks == NULL) return false;
+
+    // delayedStart nunca e 0, ja que o primeiro bloco do arquivo e reservado na sua criacao
+    unsigned int previousBlock = __getBlockAddr(file->disk, file->inode, file->delayedStart / file->diskBlockSize - 1);
+    previousBlock = __getPhysicalBlock(file->disk, previousBlock);
+
+    unsigned int goal = __getGroupFirstBlock(file->disk, inodeGetNumber(file->inode));
+    if(previousBlock > HOLE_BLOCK) goal = previousBlock + sectorsPerBlock;
+
+    // Com a compressao ou a deduplicacao ativas, os blocos que vao para as extensoes do inode sao tratados a parte
+    MountInfo* mount = __getMountInfo(file->disk);
+    bool packed = mount != NULL && (mount->compression || mount->dedupIndex != NULL) &&
+                  file->delayedStart / file->diskBlockSize + blocksNeeded > INODE_NUM_BLOCKS;
+
+    // Se o disco estiver cheio, grava apenas o que couber
+    unsigned int blocksReserved = packed ? __writePackedData(file, goal, blocks) :
+                                           __reserveBlocks(file->disk, goal, blocksNeeded, blocks);
+
+    // Dados sao gravados antes da associacao dos blocos ao inode
+    bool ioError = false;
+    unsigned int sector;
+    for(sector = 0; !packed && sector < blocksReserved * sectorsPerBlock && !ioError; sector++)
+    {
+        unsigned int position = sector * DISK_SECTORDATASIZE;
+        unsigned int length = position < file->delayedSize ? file->delayedSize - position : 0;
+
+        // Setores completos sao gravados direto de delayedData; so o ultimo, incompleto, e completado com zeros
+        unsigned char* data = diskBuffer;
+        if(length >= DISK_SECTORDATASIZE) data = (unsigned char*) &file->delayedData[position];
+        else
+        {
+            memset(diskBuffer, 0, DISK_SECTORDATASIZE);
+            if(length > 0) memcpy(diskBuffer, &file->delayedData[position], length);
+        }
+
+        if(__writeBlockSector(file->disk, blocks[sector / sectorsPerBlock] + sector % sectorsPerBlock, data) == -1)
+            ioError = true;
+    }
+
+    unsigned int blocksFlushed = ioError ? 0 : __appendBlocks(file->disk, file->inode, blocks, blocksReserved);
+
+    // Blocos reservados que nao chegaram a ser associados ao inode voltam a ficar livres
+    __setBlockListFree(file->disk, blocks + blocksFlushed, blocksReserved - blocksFlushed);
+    free(blocks);
+
+    unsigned int flushedBytes = blocksFlushed * file->diskBlockSize;
+    if(flushedBytes > file->delayedSize) flushedBytes = file->delayedSize;
+
+    if(file->delayedStart + flushedBytes > fileSize) inodeSetFileSize(file->inode, file->delayedStart + flushedBytes);
+    inodeSave(file->inode);
+
+    free(file->delayedData);
+    file->delayedData = NULL;
+    file->delayedSize = 0;
+    file->delayedCapacity = 0;
+
+    return blocksFlushed == blocksNeeded;
+}
+
+
+
+
+// Grava os dados pendentes de alocacao atrasada dos demais descritores abertos do mesmo arquivo de file, de modo que
+// leituras, escritas e consultas ao tamanho feitas por file vejam esses dados. Retorna true (!= 0) em caso de sucesso e
+// false (0) caso contrario
+bool __flushOtherDelayedData(FileInfo *file)
+{
+    unsigned int inumber = inodeGetNumber(file->inode);
+
+    int i;
+    for(i=0; i < MAX_FDS; i++)
+    {
+        FileInfo* other = openFiles[i];
+        if(other == NULL || other == file || other->delayedSize == 0 || other->disk != file->disk ||
+           inodeGetNumber(other->inode) != inumber) continue;
+
+        if(!__flushDelayedData(other)) return false;
+    }
+
+    return true;
+}
+
+
+
+
+// Estende o arquivo file ate newSize bytes sem gravar dados, antes de uma escrita alem do fim do arquivo. O trecho
+// acrescentado le como zeros: os blocos que o arquivo ja possui e os do inode principal sao zerados, e os demais viram
+// buracos (HOLE_BLOCK) no mapa de blocos, sem ocupar espaco em disco. Retorna true (!= 0) em caso de sucesso e false
+// (0) caso contrario
+bool __extendFile(FileInfo *file, unsigned int newSize)
+{
+    if(!__flushDelayedData(file)) return false;
+
+    unsigned int fileSize = inodeGetFileSize(file->inode);
+    if(newSize <= fileSize) return true;
+
+    unsigned int numBlocks;
+    unsigned int* blockMap = __loadBlockMap(file->disk, file->inode, &numBlocks);
+    if(blockMap == NULL) return false;
+    free(blockMap);
+
+    // Blocos reservados alem do fim do arquivo, o restante do ultimo bloco e os blocos do inode principal sao zerados
+    unsigned int zeroedBlocks = numBlocks > INODE_NUM_BLOCKS ? numBlocks : INODE_NUM_BLOCKS;
+    unsigned int zeroEnd = zeroedBlocks * file->diskBlockSize < newSize ? zeroedBlocks * file->diskBlockSize : newSize;
+
+    char* zeros = calloc(file->diskBlockSize, sizeof(char));
+    if(zeros == NULL) return false;
+
+    unsigned int previousCurrentByte = file->currentByte;
+    file->currentByte = fileSize;
+
+    bool success = true;
+    while(success && file->currentByte < zeroEnd)
+    {
+        unsigned int length = zeroEnd - file->currentByte;
+        if(length > file->diskBlockSize) length = file->diskBlockSize;
+
+        int written = __writeBlocks(file, zeros, length);
+        success = written != -1 && (unsigned int) written == length;
+    }
+
+    file->currentByte = previousCurrentByte;
+    free(zeros);
+    if(!success) return false;
+
+    // Os blocos seguintes sao buracos, acrescentados ao mapa de uma so vez
+    unsigned int zeroedEntries = (zeroEnd + file->diskBlockSize - 1) / file->diskBlockSize;
+    if(zeroedEntries > numBlocks) numBlocks = zeroedEntries;
+    unsigned int blocksWanted = (newSize + file->diskBlockSize - 1) / file->diskBlockSize;
+
+    if(blocksWanted > numBlocks)
+    {
+        unsigned int numHoles = blocksWanted - numBlocks;
+        unsigned int* holes = malloc(numHoles * sizeof(unsigned int));
+        if(holes == NULL) return false;
+
+        unsigned int i;
+        for(i = 0; i < numHoles; i++) holes[i] = HOLE_BLOCK;
+
+        success = __appendBlocks(file->disk, file->inode, holes, numHoles) == numHoles;
+        free(holes);
+        if(!success) return false;
+    }
+
+    inodeSetFileSize(file->inode, newSize);
+    inodeSave(file->inode);
+    return true;
+}
+
+
+
+
+// Funciona como um openDir para o diretorio raiz de um disco. Pode ser fechado normalmnte atraves de myfsClosedir.
+// Retorna um descritor de arquivo em caso de sucesso e -1 em caso de erro
+int __openRoot(Disk *d)
+{
+    int fd;
+    for(fd = 1; fd <= MAX_FDS; fd++)
+    {
+        if(openFiles[fd-1] == NULL) break;
+    }
+
+    if(fd > MAX_FDS) return -1;
+
+    FileInfo* root = openFiles[fd-1] = __newFileInfo(d, __getBlockSize(d), __acquireInode(d, ROOT_DIRECTORY_INODE));
+
+    if(root->diskBlockSize == 0 || root->inode == NULL)
+    {
+        __releaseInode(root->inode);
+        free(root);
+        openFiles[fd-1] = NULL;
+        return -1;
+    }
+
+    return fd;
+}
+
+
+
+
+bool __deleteFile(Disk *d, Inode *inode)
+{
+    unsigned int numBlocks;
+    unsigned int* blocks = __loadBlockMap(d, inode, &numBlocks);
+    if(blocks == NULL) return false;
+
+    bool blocksFreed = __setBlockListFree(d, blocks, numBlocks);
+    free(blocks);
+
+    return inodeClear(inode) == -1 ? false : blocksFreed;
+}
+
+
+
+
+bool __deleteDir(Disk *d, Inode *inode, Inode *parent)
+{
+    // Existem outras entradas no diretorio alem de . e ..
+    if(inodeGetFileSize(inode) > 2 * sizeof(DirectoryEntry)) return false;
+
+    unsigned int parentPreviousRefCount = inodeGetRefCount(parent);
+    inodeSetRefCount(parent, parentPreviousRefCount - 1);
+    inodeSave(parent);
+
+    return __deleteFile(d, inode);
+}
+
+
+
+
+bool __autoLink(int fd)
+{
+    if(fd <= 0 || fd > MAX_FDS) return false;
+    FileInfo* dir = openFiles[fd-1];
+
+    if(dir == NULL || inodeGetFileType(dir->inode) != FILETYPE_DIR) return false;
+
+    DirectoryEntry entry;
+    strcpy(entry.filename, ".");
+    entry.inumber = inodeGetNumber(dir->inode);
+
+    inodeSetRefCount(dir->inode, 1);
+
+    int bytesWritten = myfsPwrite(fd, (const char*) &entry, sizeof(DirectoryEntry), 0);
+
+    if(bytesWritten != sizeof(DirectoryEntry)) // Falha na insercao da entrada
+    {
+        // Diretorio volta ao tamanho original, caso a escrita tenha sido valida mas incompleta
+        inodeSetFileSize(dir->inode, 0);
+        inodeSave(dir->inode);
+
+        return false;
+    }
+
+    inodeSave(dir->inode);
+    return true;
+}
+
+
+
+
+// Le todas as entradas do diretorio referente ao inode dir, percorrendo seu mapa de blocos diretamente. O numero de
+// entradas e escrito em *numEntries. Retorna um vetor alocado dinamicamente, que deve ser liberado com free, ou NULL
+// em caso de erro
+DirectoryEntry* __loadDirEntries(Disk *d, Inode *dir, unsigned int *numEntries)
+{
+    unsigned int blockSize = __getBlockSize(d);
+    unsigned int dirSize = inodeGetFileSize(dir);
+    *numEntries = dirSize / sizeof(DirectoryEntry);
+
+    unsigned int numBlocks;
+    unsigned int* blocks = __loadBlockMap(d, dir, &numBlocks);
+    if(blocks == NULL) return NULL;
+
+    char* data = malloc(dirSize + DISK_SECTORDATASIZE);
+    if(blockSize == 0 || data == NULL || numBlocks * blockSize < dirSize)
+    {
+        free(blocks);
+        free(data);
+        return NULL;
+    }
+
+    unsigned int sectorsPerBlock = blockSize / DISK_SECTORDATASIZE;
+    unsigned int sector;
+    for(sector = 0; sector * DISK_SECTORDATASIZE < dirSize; sector++)
+    {
+        unsigned int addr = blocks[sector / sectorsPerBlock] + sector % sectorsPerBlock;
+        if(__readBlockSector(d, addr, (unsigned char*) &data[sector * DISK_SECTORDATASIZE]) == -1)
+        {
+            free(blocks);
+            free(data);
+            return NULL;
+        }
+    }
+
+    free(blocks);
+    return (DirectoryEntry*) data;
+}
+
+
+
+
+// Substitui os enderecos do mapa de blocos do inode de numero inumber pelos count enderecos de blocks, mantendo a
+// mesma cadeia de extensoes. count deve ser igual ao numero de blocos do mapa atual. Cada inode da cadeia e escrito
+// apenas uma vez. Retorna true (!= 0) em caso de sucesso e false (0) caso contrario
+bool __replaceBlockMap(Disk *d, unsigned int inumber, const unsigned int *blocks, unsigned int count)
+{
+    unsigned int items[INODE_NUM_ITEMS];
+    unsigned int current = inumber;
+    unsigned int replaced = 0;
+    bool isBase = true;
+
+    while(current != 0 && replaced < count)
+    {
+        if(!__readInodeItems(d, current, items)) return false;
+
+        unsigned int slots = isBase ? INODE_NUM_BLOCKS : INODE_EXT_NUM_BLOCKS;
+        unsigned int i;
+        for(i = 0; i < slots && replaced < count && items[i] != 0; i++) items[i] = blocks[replaced++];
+
+        if(!__writeInodeItems(d, current, items)) return false;
+
+        current = items[INODE_ITEM_NEXT];
+        isBase = false;
+    }
+
+    return replaced == count;
+}
+
+
+
+
+// Retorna o numero de sequencias contiguas no vetor de count enderecos de bloco blocks, em que cada bloco ocupa
+// sectorsPerBlock setores. Um arquivo sem fragmentacao tem uma unica sequencia
+unsigned int __countBlockRuns(const unsigned int *blocks, unsigned int count, unsigned int sectorsPerBlock)
+{
+    unsigned int runs = 0;
+    unsigned int previous = 0;
+
+    // Buracos de arquivos esparsos nao ocupam blocos e nao interrompem uma sequencia
+    unsigned int i;
+    for(i = 0; i < count; i++)
+    {
+        if(blocks[i] == HOLE_BLOCK) continue;
+
+        // Blocos comprimidos contam a partir do setor em que seus dados comecam
+        unsigned int block = blocks[i] & COMPRESSED_BLOCK_FLAG ? blocks[i] & COMPRESSED_SECTOR_MASK : blocks[i];
+
+        if(previous == 0 || block != previous + sectorsPerBlock) runs++;
+        previous = block;
+    }
+
+    return runs;
+}
+
+
+
+
+// Estima quantos cilindros as cabecas do disco percorrem para ler em ordem os count blocos de blocks, partindo do
+// cilindro do primeiro bloco
+unsigned long __estimateSeekCylinders(Disk *d, const unsigned int *blocks, unsigned int count)
+{
+    unsigned long total = 0;
+    unsigned long previous, current;
+    bool first = true;
+
+    unsigned int i;
+    for(i = 0; i < count; i++)
+    {
+        unsigned int block = blocks[i] & COMPRESSED_BLOCK_FLAG ? blocks[i] & COMPRESSED_SECTOR_MASK : blocks[i];
+        if(block == HOLE_BLOCK || diskAddrToCylinder(d, block, &current) == -1) continue;
+
+        if(!first) total += current > previous ? current - previous : previous - current;
+        previous = current;
+        first = false;
+    }
+
+    return total;
+}
+
+
+
+
+// Retorna true (!= 0) se o inode de numero inumber do disco d estiver aberto em algum descritor de arquivo
+bool __isInodeOpen(Disk *d, unsigned int inumber)
+{
+    int fd;
+    for(fd = 1; fd <= MAX_FDS; fd++)
+    {
+        FileInfo* file = openFiles[fd-1];
+        if(file != NULL && file->disk == d && inodeGetNumber(file->inode) == inumber) return true;
+    }
+
+    return false;
+}
+
+
+
+
+// Move os blocos do arquivo de inode inumber para uma unica sequencia contigua, se ele estiver fragmentado e tiver
+// no maximo maxBlocks blocos. Os dados sao copiados antes de o mapa de blocos ser atualizado e os blocos antigos so
+// sao liberados depois, de modo que uma falha no meio do processo nunca deixa o mapa apontando para dados
+// incompletos. Atualiza report com a fragmentacao antes e depois. Retorna o numero de blocos movidos, 0 se o arquivo
+// foi mantido como estava
+unsigned int __defragFile(Disk *d, unsigned int inumber, unsigned int maxBlocks, DefragReport *report)
+{
+    unsigned int sectorsPerBlock = __getBlockSize(d) / DISK_SECTORDATASIZE;
+
+    Inode* inode = __acquireInode(d, inumber);
+    if(inode == NULL) return 0;
+
+    unsigned int numBlocks;
+    unsigned int* blocks = __loadBlockMap(d, inode, &numBlocks);
+    __releaseInode(inode);
+    if(blocks == NULL) return 0;
+
+    unsigned int runsBefore = __countBlockRuns(blocks, numBlocks, sectorsPerBlock);
+    unsigned long seekBefore = __estimateSeekCylinders(d, blocks, numBlocks);
+
+    report->filesScanned++;
+    report->runsBefore += runsBefore;
+    report->seekCylindersBefore += seekBefore;
+
+    if(runsBefore > 1) report->filesFragmented++;
+
+    // Buracos de arquivos esparsos continuam buracos, so os blocos de dados sao movidos. Mover um bloco compartilhado
+    // com um clone o duplicaria, e blocos comprimidos dividem blocos do disco, entao esses arquivos nao sao
+    // desfragmentados
+    unsigned int numDataBlocks = 0;
+    bool hasShared = false;
+    unsigned int i;
+    for(i = 0; i < numBlocks; i++)
+    {
+        if(blocks[i] != HOLE_BLOCK) numDataBlocks++;
+        if(blocks[i] & COMPRESSED_BLOCK_FLAG) hasShared = true;
+        if(runsBefore > 1 && i >= INODE_NUM_BLOCKS && !hasShared && __getBlockRefs(d, blocks[i]) > 0) hasShared = true;
+    }
+
+    // Arquivos contiguos, maiores que o limite restante ou sem sequencia livre do tamanho do arquivo ficam como estao
+    unsigned int allocated = 0;
+    unsigned int newFirst = 0;
+    if(runsBefore > 1 && numDataBlocks <= maxBlocks && !hasShared)
+        newFirst = __findFreeBlocks(d, __getGroupFirstBlock(d, inumber), numDataBlocks, &allocated);
+
+    if(newFirst != 0 && allocated < numDataBlocks)
+    {
+        __setBlocksFree(d, newFirst, allocated);
+        newFirst = 0;
+    }
+
+    if(newFirst == 0)
+    {
+        report->runsAfter += runsBefore;
+        report->seekCylindersAfter += seekBefore;
+        free(blocks);
+        return 0;
+    }
+
+    unsigned int* newBlocks = malloc(numBlocks * sizeof(unsigned int));
+    bool copied = newBlocks != NULL;
+
+    unsigned char buffer[DISK_SECTORDATASIZE];
+    unsigned int sector;
+    unsigned int moved = 0;
+    for(i = 0; i < numBlocks && copied; i++)
+    {
+        if(blocks[i] == HOLE_BLOCK)
+        {
+            newBlocks[i] = HOLE_BLOCK;
+            continue;
+        }
+
+        newBlocks[i] = newFirst + (moved++) * sectorsPerBlock;
+
+        for(sector = 0; sector < sectorsPerBlock && copied; sector++)
+        {
+            copied = __readBlockSector(d, blocks[i] + sector, buffer) != -1 &&
+                     __writeBlockSector(d, newBlocks[i] + sector, buffer) != -1;
+        }
+    }
+
+    if(!copied || !__replaceBlockMap(d, inumber, newBlocks, numBlocks))
+    {
+        // O mapa pode ter sido parcialmente reescrito, entao volta a apontar para os blocos originais
+        if(copied) __replaceBlockMap(d, inumber, blocks, numBlocks);
+        __setBlocksFree(d, newFirst, numDataBlocks);
+
+        report->runsAfter += runsBefore;
+        report->seekCylindersAfter += seekBefore;
+        free(blocks);
+        free(newBlocks);
+        return 0;
+    }
+
+    __setBlockListFree(d, blocks, numBlocks);
+
+    report->filesDefragmented++;
+    report->blocksMoved += numDataBlocks;
+    report->runsAfter += 1;
+    report->seekCylindersAfter += __estimateSeekCylinders(d, newBlocks, numBlocks);
+
+    free(blocks);
+    free(newBlocks);
+    return numDataBlocks;
+}
+
+
+
+
+// Le do disco a pagina page do mapeamento map para data, zerando os bytes alem do fim do arquivo. Modificacoes do bloco
+// ainda no cache de algum descritor sao gravadas antes. Retorna true (!= 0) em caso de sucesso e false (0) caso
+// contrario
+bool __readMappedPage(FileMapping *map, unsigned int page, unsigned char *data)
+{
+    FileInfo* file = openFiles[map->fd-1];
+    unsigned int block = map->blocks[page];
+
+    if(block == HOLE_BLOCK)
+    {
+        memset(data, 0, map->pageSize);
+        return true;
+    }
+
+    if(!__syncBlockCaches(file, block, false)) return false;
+    if(file->cacheBlock == block && !__flushBlockCache(file)) return false;
+
+    unsigned int pageBytes = map->length - page * map->pageSize;
+    if(pageBytes > map->pageSize) pageBytes = map->pageSize;
+
+    if(block & COMPRESSED_BLOCK_FLAG)
+    {
+        if(!__readCompressedBlock(file->disk, block, map->pageSize, data)) return false;
+    }
+    else
+    {
+        unsigned int i;
+        for(i=0; i * DISK_SECTORDATASIZE < pageBytes; i++)
+        {
+            if(__readBlockSector(file->disk, block + i, &data[i * DISK_SECTORDATASIZE]) == -1) return false;
+        }
+    }
+
+    memset(&data[pageBytes], 0, map->pageSize - pageBytes);
+    return true;
+}
+
+
+
+
+// Le para data numSectors setores do arquivo file, a partir do setor firstSector contado do inicio do arquivo, usando
+// o mapa de blocos blocks de numBlocks enderecos ja carregado. Buracos e setores alem do mapa leem como zeros, e o
+// bloco em cache no descritor e lido do cache. Retorna true (!= 0) em caso de sucesso e false (0) caso contrario
+bool __readFileSectors(FileInfo *file, const unsigned int *blocks, unsigned int numBlocks, unsigned int firstSector,
+                       unsigned int numSectors, unsigned char *data)
+{
+    unsigned int sectorsPerBlock = file->diskBlockSize / DISK_SECTORDATASIZE;
+
+    unsigned int i;
+    for(i = 0; i < numSectors; i++)
+    {
+        unsigned int blockNum = (firstSector + i) / sectorsPerBlock;
+        unsigned int sectorInBlock = (firstSector + i) % sectorsPerBlock;
+        unsigned char* sector = &data[i * DISK_SECTORDATASIZE];
+
+        unsigned int block = blockNum < numBlocks ? blocks[blockNum] : HOLE_BLOCK;
+
+        if(block == HOLE_BLOCK) memset(sector, 0, DISK_SECTORDATASIZE);
+        else if(block == file->cacheBlock || (block & COMPRESSED_BLOCK_FLAG))
+        {
+            // Blocos comprimidos sao descomprimidos no cache do descritor
+            unsigned char* cache = __loadBlockCache(file, blockNum, block, false);
+            if(cache == NULL) return false;
+
+            memcpy(sector, &cache[sectorInBlock * DISK_SECTORDATASIZE], DISK_SECTORDATASIZE);
+        }
+        else
+        {
+            // Os caches de outros descritores sao sincronizados uma vez por bloco, no primeiro setor lido dele
+            if((i == 0 || sectorInBlock == 0) && !__syncBlockCaches(file, block, false)) return false;
+            if(__readBlockSector(file->disk, block + sectorInBlock, sector) == -1) return false;
+        }
+    }
+
+    return true;
+}
+
+
+
+
+// Escreve em out, a partir da posicao *position, o restante length de um tamanho de literais ou de repeticao do
+// formato LZ4 que nao coube nos 4 bits do token: bytes 255 seguidos de um byte final menor que 255
+void __writeLzLength(unsigned char *out, unsigned int *position, unsigned int length)
+{
+    while(length >= 255)
+    {
+        out[(*position)++] = 255;
+        length -= 255;
+    }
+
+    out[(*position)++] = (unsigned char) length;
+}
+
+
+
+
+// Retorna o numero de bytes que um tamanho de literais ou de repeticao do formato LZ4, ja descontado o minimo da
+// repeticao, ocupa alem dos 4 bits do token: 0 se length cabe no token, ou os bytes escritos por __writeLzLength
+unsigned int __lzLengthBytes(unsigned int length)
+{
+    return length < 15 ? 0 : (length - 15) / 255 + 1;
+}
+
+
+
+
+// Comprime os size bytes de data no formato de bloco do LZ4: sequencias de um token, literais copiados e uma
+// repeticao de pelo menos LZ_MIN_MATCH bytes, dada pela distancia (2 bytes) ate uma ocorrencia anterior. As
+// repeticoes sao encontradas por uma tabela de hash dos ultimos 4 bytes, sem busca de alternativas. Retorna o
+// tamanho dos dados comprimidos em out, ou 0 se eles nao couberem em capacity bytes
+unsigned int __compressBlock(const unsigned char *data, unsigned int size, unsigned char *out, unsigned int capacity)
+{
+    unsigned int table[1 << LZ_HASH_BITS] = {0}; // Posicao mais 1 da ultima ocorrencia de cada hash, 0 se nenhuma
+    unsigned int anchor = 0;                      // Inicio dos literais ainda nao escritos
+    unsigned int position = 0;
+    unsigned int written = 0;
+
+    while(size > LZ_MATCH_LIMIT && position < size - LZ_MATCH_LIMIT)
+    {
+        unsigned int sequence;
+        memcpy(&sequence, &data[position], sizeof(unsigned int));
+
+        unsigned int hash = (sequence * 2654435761u) >> (32 - LZ_HASH_BITS);
+        unsigned int candidate = table[hash];
+        table[hash] = position + 1;
+
+        if(candidate == 0 || position - (candidate - 1) > LZ_MAX_OFFSET ||
+           memcmp(&data[candidate - 1], &data[position], LZ_MIN_MATCH) != 0)
+        {
+            position++;
+            continue;
+        }
+
+        unsigned int match = candidate - 1;
+        unsigned int matchLength = LZ_MIN_MATCH;
+        while(position + matchLength < size - LZ_LAST_LITERALS &&
+              data[match + matchLength] == data[position + matchLength])
+            matchLength++;
+
+        unsigned int literals = position - anchor;
+
+        // Tamanho da sequencia: token, tamanhos estendidos, literais e distancia
+        if(written + 1 + __lzLengthBytes(literals) + literals + 2 + __lzLengthBytes(matchLength - LZ_MIN_MATCH) >
+           capacity) return 0;
+
+        unsigned int token = written++;
+        out[token] = (unsigned char) ((literals < 15 ? literals : 15) << 4);
+        if(literals >= 15) __writeLzLength(out, &written, literals - 15);
+
+        memcpy(&out[written], &data[anchor], literals);
+        written += literals;
+
+        out[written++] = (unsigned char) ((position - match) & 0xFF);
+        out[written++] = (unsigned char) ((position - match) >> 8);
+
+        out[token] |= (unsigned char) (matchLength - LZ_MIN_MATCH < 15 ? matchLength - LZ_MIN_MATCH : 15);
+        if(matchLength - LZ_MIN_MATCH >= 15) __writeLzLength(out, &written, matchLength - LZ_MIN_MATCH - 15);
+
+        position += matchLength;
+        anchor = position;
+    }
+
+    // A ultima sequencia tem apenas literais
+    unsigned int literals = size - anchor;
+    if(written + 1 + __lzLengthBytes(literals) + literals > capacity) return 0;
+
+    unsigned int token = written++;
+    out[token] = (unsigned char) ((literals < 15 ? literals : 15) << 4);
+    if(literals >= 15) __writeLzLength(out, &written, literals - 15);
+
+    memcpy(&out[written], &data[anchor], literals);
+    return written + literals;
+}
+
+
+
+
+// Descomprime os dados de in, no formato de bloco do LZ4, ate preencher os size bytes de data. Bytes de in alem do fim
+// dos dados comprimidos sao ignorados. Retorna true (!= 0) em caso de sucesso e false (0) se os dados comprimidos
+// forem invalidos ou terminarem antes de preencher data
+bool __decompressBlock(const unsigned char *in, unsigned int inSize, unsigned char *data, unsigned int size)
+{
+    unsigned int input = 0;
+    unsigned int output = 0;
+
+    while(output < size)
+    {
+        if(input >= inSize) return false;
+        unsigned int token = in[input++];
+
+        unsigned int literals = token >> 4;
+        if(literals == 15)
+        {
+            unsigned int extra;
+            do
+            {
+                if(input >= inSize) return false;
+                extra = in[input++];
+                literals += extra;
+            } while(extra == 255);
+        }
+
+        if(literals > inSize - input || literals > size - output) return false;
+
+        memcpy(&data[output], &in[input], literals);
+        input += literals;
+        output += literals;
+
+        if(output == size) break;
+
+        if(inSize - input < 2) return false;
+        unsigned int offset = in[input] | (in[input + 1] << 8);
+        input += 2;
+
+        unsigned int matchLength = (token & 15) + LZ_MIN_MATCH;
+        if((token & 15) == 15)
+        {
+            unsigned int extra;
+            do
+            {
+                if(input >= inSize) return false;
+                extra = in[input++];
+                matchLength += extra;
+            } while(extra == 255);
+        }
+
+        if(offset == 0 || offset > output || matchLength > size - output) return false;
+
+        // A repeticao pode se sobrepor ao trecho que esta sendo escrito, entao e copiada byte a byte
+        unsigned int i;
+        for(i = 0; i < matchLength; i++) data[output + i] = data[output - offset + i];
+        output += matchLength;
+    }
+
+    return true;
+}
+
+
+
+
+// Le do disco d o bloco comprimido de endereco addr (com COMPRESSED_BLOCK_FLAG) e o descomprime nos blockSize bytes de
+// data. Retorna true (!= 0) em caso de sucesso e false (0) caso contrario
+bool __readCompressedBlock(Disk *d, unsigned int addr, unsigned int blockSize, unsigned char *data)
+{
+    unsigned int firstSector = addr & COMPRESSED_SECTOR_MASK;
+    unsigned int numSectors = (addr & ~COMPRESSED_BLOCK_FLAG) >> COMPRESSED_SECTORS_SHIFT;
+
+    unsigned char* compressed = malloc(numSectors * DISK_SECTORDATASIZE);
+    if(compressed == NULL) return false;
+
+    bool success = true;
+    unsigned int i;
+    for(i = 0; i < numSectors && success; i++)
+        success = __readBlockSector(d, firstSector + i, &compressed[i * DISK_SECTORDATASIZE]) != -1;
+
+    if(success) success = __decompressBlock(compressed, numSectors * DISK_SECTORDATASIZE, data, blockSize);
+
+    free(compressed);
+    return success;
+}
+
+
+
+
+// Tabelas do CRC32C para o calculo por software, 8 bytes por vez: crc32cTable[0] e a tabela usual de um byte, e
+// crc32cTable[k] avanca o efeito de um byte por mais k bytes. Geradas no primeiro uso
+unsigned int crc32cTable[8][256];
+bool crc32cTableReady = false;
+
+
+
+
+// Atualiza o CRC32C crc, ainda sem a inversao final, com os size bytes de data, usando as tabelas crc32cTable.
+// Retorna o CRC atualizado
+unsigned int __crc32cSoftware(unsigned int crc, const unsigned char *data, unsigned int size)
+{
+    if(!crc32cTableReady)
+    {
+        unsigned int i;
+        for(i = 0; i < 256; i++)
+        {
+            unsigned int value = i;
+
+            int bit;
+            for(bit = 0; bit < 8; bit++) value = (value >> 1) ^ (value & 1 ? CRC32C_POLYNOMIAL : 0);
+            crc32cTable[0][i] = value;
+        }
+
+        for(i = 0; i < 256; i++)
+        {
+            int k;
+            for(k = 1; k < 8; k++)
+                crc32cTable[k][i] = (crc32cTable[k-1][i] >> 8) ^ crc32cTable[0][crc32cTable[k-1][i] & 0xFF];
+        }
+
+        crc32cTableReady = true;
+    }
+
+    while(size >= 8)
+    {
+        unsigned int low = crc ^ ((unsigned int) data[0] | (unsigned int) data[1] << 8 |
+                                  (unsigned int) data[2] << 16 | (unsigned int) data[3] << 24);
+
+        crc = crc32cTable[7][low & 0xFF] ^ crc32cTable[6][(low >> 8) & 0xFF] ^
+              crc32cTable[5][(low >> 16) & 0xFF] ^ crc32cTable[4][low >> 24] ^
+              crc32cTable[3][data[4]] ^ crc32cTable[2][data[5]] ^ crc32cTable[1][data[6]] ^ crc32cTable[0][data[7]];
+
+        data += 8;
+        size -= 8;
+    }
+
+    while(size-- > 0) crc = (crc >> 8) ^ crc32cTable[0][(crc ^ *data++) & 0xFF];
+
+    return crc;
+}
+
+
+
+
+#ifdef CRC32C_SSE42
+// Atualiza o CRC32C crc, ainda sem a inversao final, com os size bytes de data, usando a instrucao crc32 do SSE4.2
+// sobre 8 bytes por vez. So deve ser chamada se o processador possuir SSE4.2. Retorna o CRC atualizado
+__attribute__((target("sse4.2")))
+unsigned int __crc32cHardware(unsigned int crc, const unsigned char *data, unsigned int size)
+{
+    unsigned long long value = crc;
+
+    while(size >= 8)
+    {
+        unsigned long long word;
+        memcpy(&word, data, sizeof(unsigned long long));
+        value = _mm_crc32_u64(value, word);
+
+        data += 8;
+        size -= 8;
+    }
+
+    crc = (unsigned int) value;
+    while(size-- > 0) crc = _mm_crc32_u8(crc, *data++);
+
+    return crc;
+}
+#endif
+
+
+
+
+// Calcula o CRC32C (polinomio de Castagnoli) dos size bytes de data, com a instrucao do processador quando disponivel
+unsigned int __crc32c(const unsigned char *data, unsigned int size)
+{
+#ifdef CRC32C_SSE42
+    if(__builtin_cpu_supports("sse4.2")) return ~__crc32cHardware(~0u, data, size);
+#endif
+
+    return ~__crc32cSoftware(~0u, data, size);
+}
+
+
+
+
+// Inicializa fsLock como uma trava recursiva, que a thread que a possui pode obter de novo, ja que as funcoes publicas
+// do myfs chamam umas as outras. Executada uma unica vez, pela primeira chamada de __lockFs
+void __initFsLock(void)
+{
+    pthread_mutexattr_t attributes;
+    pthread_mutexattr_init(&attributes);
+    pthread_mutexattr_settype(&attributes, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&asyncPool.fsLock, &attributes);
+    pthread_mutexattr_destroy(&attributes);
+}
+
+
+
+
+// Obtem fsLock, mantida por cada funcao publica do myfs durante sua execucao
+void __lockFs(void)
+{
+    pthread_once(&asyncPool.fsLockInit, __initFsLock);
+    pthread_mutex_lock(&asyncPool.fsLock);
+}
+
+
+
+
+// Libera fsLock, obtida por __lockFs
+void __unlockFs(void)
+{
+    pthread_mutex_unlock(&asyncPool.fsLock);
+}
+
+
+
+
+// Executa a operacao assincrona request, ja retirada da fila, e chama o seu callback apos o termino, fora das travas,
+// de modo que ele possa enfileirar novas operacoes ou chamar qualquer outra funcao do myfs. Libera request
+void __runAsyncRequest(AsyncRequest *request)
+{
+    int result = request->write ? myfsPwrite(request->fd, request->buf, request->nbytes, request->offset) :
+                                  myfsPread(request->fd, request->buf, request->nbytes, request->offset);
+
+    pthread_mutex_lock(&asyncPool.lock);
+    asyncPool.fdPending[request->fd - 1]--;
+    pthread_cond_broadcast(&asyncPool.fdDone);
+    pthread_mutex_unlock(&asyncPool.lock);
+
+    if(request->callback != NULL) request->callback(request->fd, result, request->arg);
+    free(request);
+
+    pthread_mutex_lock(&asyncPool.lock);
+    if(--asyncPool.pending == 0) pthread_cond_broadcast(&asyncPool.allDone);
+    pthread_mutex_unlock(&asyncPool.lock);
+}
+
+
+
+
+// Executa as operacoes da fila de operacoes assincronas, uma de cada vez, chamando o callback de cada uma apos o seu
+// termino. Funcao de cada thread do conjunto, que nunca retorna
+void* __asyncWorker(void *arg)
+{
+    (void) arg;
+
+    while(true)
+    {
+        pthread_mutex_lock(&asyncPool.lock);
+        while(asyncPool.head == NULL) pthread_cond_wait(&asyncPool.workAvailable, &asyncPool.lock);
+
+        AsyncRequest* request = asyncPool.head;
+        asyncPool.head = request->next;
+        if(asyncPool.head == NULL) asyncPool.tail = NULL;
+        pthread_mutex_unlock(&asyncPool.lock);
+
+        __runAsyncRequest(request);
+    }
+
+    return NULL;
+}
+
+
+
+
+// Coloca request no fim da fila de operacoes assincronas, criando as threads do conjunto na primeira chamada. Retorna
+// true (!= 0) em caso de sucesso e false (0) se nenhuma thread puder ser criada, caso em que request nao e enfileirada
+bool __submitAsync(AsyncRequest *request)
+{
+    pthread_mutex_lock(&asyncPool.lock);
+
+    while(asyncPool.numWorkers < ASYNC_NUM_WORKERS &&
+          pthread_create(&asyncPool.workers[asyncPool.numWorkers], NULL, __asyncWorker, NULL) == 0)
+    {
+        pthread_detach(asyncPool.workers[asyncPool.numWorkers]);
+        asyncPool.numWorkers++;
+    }
+
+    if(asyncPool.numWorkers == 0 || openFiles[request->fd - 1] == NULL)
+    {
+        pthread_mutex_unlock(&asyncPool.lock);
+        return false;
+    }
+
+    request->next = NULL;
+    if(asyncPool.tail != NULL) asyncPool.tail->next = request;
+    else asyncPool.head = request;
+    asyncPool.tail = request;
+    asyncPool.pending++;
+    asyncPool.fdPending[request->fd - 1]++;
+
+    pthread_cond_signal(&asyncPool.workAvailable);
+    pthread_mutex_unlock(&asyncPool.lock);
+    return true;
+}
+
+
+
+
+// Espera o fim das operacoes assincronas do descritor fd, antes de ele ser fechado. As operacoes ainda na fila sao
+// retiradas dela e executadas pela propria thread, de modo que a espera termine mesmo quando chamada pelos callbacks de
+// todas as threads do conjunto; apenas as ja em execucao sao esperadas. Nao deve ser chamada com fsLock mantido, que
+// as operacoes em execucao precisam obter
+void __waitAsyncRequests(int fd)
+{
+    pthread_mutex_lock(&asyncPool.lock);
+
+    while(asyncPool.fdPending[fd-1] > 0)
+    {
+        AsyncRequest* previous = NULL;
+        AsyncRequest* request = asyncPool.head;
+        while(request != NULL && request->fd != fd)
+        {
+            previous = request;
+            request = request->next;
+        }
+
+        if(request == NULL)
+        {
+            pthread_cond_wait(&asyncPool.fdDone, &asyncPool.lock);
+            continue;
+        }
+
+        if(previous != NULL) previous->next = request->next;
+        else asyncPool.head = request->next;
+        if(asyncPool.tail == request) asyncPool.tail = previous;
+
+        pthread_mutex_unlock(&asyncPool.lock);
+        __runAsyncRequest(request);
+        pthread_mutex_lock(&asyncPool.lock);
+    }
+
+    pthread_mutex_unlock(&asyncPool.lock);
+}
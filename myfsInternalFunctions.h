@@ -17,6 +17,7 @@
 #define SO_TRABALHO2_MYFSINTERNALFUNCTIONS_H
 
 
+#include <pthread.h>
 #include <stdbool.h>
 #include "disk.h"
 #include "myfs.h"
@@ -28,12 +29,219 @@
 #define SUPERBLOCK_FREE_SPACE_SECTOR (sizeof(unsigned int) + sizeof(char))
 #define SUPERBLOCK_FIRST_BLOCK_SECTOR (2 * sizeof(unsigned int) + sizeof(char))
 #define SUPERBLOCK_NUM_BLOCKS (3 * sizeof(unsigned int) + sizeof(char))
+#define SUPERBLOCK_BLOCKS_PER_GROUP (4 * sizeof(unsigned int) + sizeof(char))
+#define SUPERBLOCK_REFCOUNT_SECTOR (5 * sizeof(unsigned int) + sizeof(char))
+#define SUPERBLOCK_CHECKSUM_SECTOR (6 * sizeof(unsigned int) + sizeof(char))
+#define SUPERBLOCK_CHECKSUMS_STALE (7 * sizeof(unsigned int) + sizeof(char))
+
+/// Numero de blocos representados por um setor da tabela de referencias, que guarda um unsigned int por bloco com o
+/// numero de arquivos que o compartilham alem do primeiro. A tabela fica no fim do disco, apos a area de blocos
+#define REFS_PER_SECTOR (DISK_SECTORDATASIZE / sizeof(unsigned int))
+
+/// Numero de setores da area de blocos representados por um setor da area de checksums, que guarda o CRC32C de cada
+/// setor da area de blocos, ou 0 para um setor ainda sem checksum. A area fica entre o mapa de bits e a area de blocos
+#define CHECKSUMS_PER_SECTOR (DISK_SECTORDATASIZE / sizeof(unsigned int))
+
+/// O CRC32C e calculado com a instrucao crc32 do SSE4.2 quando o processador a possui, e por tabelas caso contrario
+#if defined(__GNUC__) && defined(__x86_64__)
+#define CRC32C_SSE42
+#endif
+
+/// Polinomio de Castagnoli do CRC32C, na forma refletida
+#define CRC32C_POLYNOMIAL 0x82F63B78u
+
+/// Numero de cilindros de disco em cada grupo de cilindros. Cada grupo possui sua fatia de inodes, do mapa de bits e
+/// da area de blocos, de modo que os blocos de um arquivo fiquem proximos entre si e dos arquivos do mesmo diretorio
+#define CYLINDERS_PER_GROUP 16
 
 #define ROOT_DIRECTORY_INODE 1
 
+/// Layout de um inode em disco, conforme inode.c: INODE_NUM_ITEMS unsigned ints por inode, dos quais os primeiros
+/// INODE_NUM_BLOCKS (ou INODE_EXT_NUM_BLOCKS, em extensoes) sao enderecos de bloco e o ultimo e o numero da proxima
+/// extensao
+#define INODE_NUM_ITEMS 16
+#define INODE_NUM_BLOCKS 8
+#define INODE_EXT_NUM_BLOCKS 14
+#define INODE_ITEM_NUMBER (INODE_NUM_ITEMS - 2)
+#define INODE_ITEM_NEXT (INODE_NUM_ITEMS - 1)
+
+/// Endereco que marca, no mapa de blocos de um arquivo esparso, um bloco que nunca foi escrito e le como zeros. O setor
+/// 1 fica entre o superbloco e a area de inodes, entao nunca e um bloco de dados. Buracos so aparecem nas extensoes do
+/// inode, ja que os enderecos do inode principal sao mantidos pelo inode em memoria
+#define HOLE_BLOCK 1
+
+/// Enderecos de blocos comprimidos no mapa de blocos: o bit mais alto marca o endereco, os 7 bits seguintes guardam o
+/// numero de setores ocupados pelos dados comprimidos e os 24 restantes o setor em que eles comecam. Blocos comprimidos
+/// pequenos dividem um mesmo bloco do disco, que ganha na tabela de referencias uma referencia por bloco comprimido
+/// alem do primeiro. Como os buracos, so aparecem nas extensoes do inode
+#define COMPRESSED_BLOCK_FLAG 0x80000000u
+#define COMPRESSED_SECTORS_SHIFT 24
+#define COMPRESSED_MAX_SECTORS 0x7Fu
+#define COMPRESSED_SECTOR_MASK 0x00FFFFFFu
+
+/// Maximo de bytes mantidos em memoria por arquivo aberto antes que a alocacao atrasada seja forcada
+#define DELAYED_ALLOCATION_LIMIT (256 * 1024)
+
+/// Menor e maior janela da leitura antecipada, em blocos
+#define READ_AHEAD_MIN_BLOCKS 4
+#define READ_AHEAD_MAX_BLOCKS 32
+
+/// Maximo de bytes transferidos de uma vez por myfsCopyRange, lidos em sequencia da origem e gravados no destino
+#define COPY_RANGE_CHUNK (64 * 1024)
+
+/// Maximo de bytes de trechos pequenos reunidos por myfsReadv e myfsWritev em uma unica leitura ou escrita
+#define IOVEC_CHUNK (64 * 1024)
+
+/// Numero de blocos representados por cada palavra do resumo do mapa de bits (4 bytes do mapa)
+#define BITMAP_WORD_BITS 32
+
+/// Numero maximo de discos em formato myfs com contexto carregado em memoria ao mesmo tempo
+#define MAX_MOUNTS 4
+
+/// Resumo em memoria do mapa de bits de um disco, organizado em niveis: o total de blocos livres do disco; o numero de
+/// blocos livres de cada grupo; para cada setor do mapa de bits, o numero de blocos livres e as maiores sequencias
+/// livres no inicio, no fim e em qualquer ponto do setor; e um bit por palavra de BITMAP_WORD_BITS blocos indicando se
+/// ela possui algum bloco livre. E construido a partir do mapa de bits na primeira alocacao em um disco e mantido
+/// atualizado pelas funcoes que escrevem no mapa de bits
+typedef struct
+{
+    unsigned int numSectors;      // Numero de setores do mapa de bits que representam blocos
+    unsigned int totalFree;
+    unsigned int *groupFree;
+    unsigned int *sectorFree;     // NULL se o resumo nao foi carregado
+    unsigned int *sectorHeadRun;
+    unsigned int *sectorTailRun;
+    unsigned int *sectorMaxRun;
+    unsigned char *wordHasFree;
+} FreeSpaceSummary;
+
+/// Arvores de extensoes livres: cada extensao participa de uma arvore AVL ordenada por posicao e de outra ordenada por
+/// tamanho, indexadas por EXTENT_BY_OFFSET e EXTENT_BY_LENGTH
+#define EXTENT_BY_OFFSET 0
+#define EXTENT_BY_LENGTH 1
+
+/// Sequencia de blocos livres e contiguos, indexada pelas duas arvores de extensoes livres de um disco
+typedef struct FreeExtent
+{
+    unsigned int start;           // Indice do primeiro bloco, contado a partir do inicio da area de blocos
+    unsigned int length;
+    unsigned int maxLength;       // Maior tamanho de extensao na subarvore por posicao deste no
+    struct FreeExtent *left[2];
+    struct FreeExtent *right[2];
+    int height[2];
+} FreeExtent;
+
+/// Numero de entradas do indice de deduplicacao de um disco, divididas em conjuntos de DEDUP_INDEX_WAYS entradas. O
+/// hash do conteudo de um bloco escolhe o seu conjunto, e um bloco novo em um conjunto cheio substitui um dos que la
+/// estavam, de modo que a memoria usada e fixa
+#define DEDUP_INDEX_SIZE 4096
+#define DEDUP_INDEX_WAYS 4
+
+/// Entrada do indice de deduplicacao: hash do conteudo de um bloco das extensoes de algum arquivo e o endereco desse
+/// bloco no mapa de blocos, comprimido ou nao
+typedef struct
+{
+    unsigned long long hash;
+    unsigned int block;           // 0 se a entrada esta vazia
+} DedupEntry;
+
+/// Contexto de um disco em formato myfs: geometria lida do superbloco uma unica vez e estado em memoria do alocador.
+/// Criado no primeiro acesso ao disco e descartado quando o disco e formatado ou desmontado
+typedef struct
+{
+    Disk *disk;                   // NULL se a posicao esta livre
+    int diskId;
+    unsigned int blockSize;
+    unsigned int sectorsPerBlock;
+    unsigned int freeSpaceSector;
+    unsigned int firstBlockSector;
+    unsigned int numBlocks;
+    unsigned int numInodes;
+    unsigned int numGroups;
+    unsigned int blocksPerGroup;
+    unsigned int inodesPerGroup;
+    FreeSpaceSummary freeSpace;
+
+    // Politica de alocacao (MYFS_ALLOC_*) e arvores de extensoes livres, construidas so quando a politica as usa
+    int allocPolicy;
+    unsigned int nextFitIndex;    // Indice do bloco seguinte a ultima alocacao, ponto de partida de NEXT_FIT
+    bool extentsLoaded;
+    FreeExtent *extentRoot[2];
+
+    // Tabela de referencias dos blocos compartilhados por clones de arquivos. refCountSector e 0 em discos formatados
+    // sem a tabela, que nao aceitam clones
+    unsigned int refCountSector;
+    unsigned int *sectorShared;   // Blocos compartilhados em cada setor da tabela, contados sob demanda; NULL se vazio
+
+    bool compression;             // Blocos gravados pela alocacao atrasada sao comprimidos (myfsSetCompression)
+    DedupEntry *dedupIndex;       // Indice dos blocos gravados pela alocacao atrasada; NULL se a deduplicacao esta
+                                  // desativada (myfsSetDedup)
+
+    // Checksums dos setores da area de blocos, carregados de uma vez no primeiro acesso e mantidos em memoria. Os
+    // setores modificados da area de checksums sao gravados junto com os caches dos arquivos, em myfsFlush e
+    // myfsClose, e antes de o disco ser desmontado; um contexto com checksums nao gravados nunca e reaproveitado.
+    // checksumSector e 0 em discos formatados sem a area, cujos setores nao sao verificados
+    unsigned int checksumSector;
+    unsigned int *checksums;      // NULL se nao carregados
+    unsigned char *checksumDirty; // Um indicador por setor da area de checksums
+    bool checksumsDirty;
+} MountInfo;
+
+/// Numero maximo de inodes mantidos em memoria ao mesmo tempo: um por arquivo aberto, mais os usados temporariamente
+/// pelas operacoes de diretorio
+#define MAX_OPEN_INODES (MAX_FDS + 16)
+
+/// Inode em memoria compartilhado por todos os descritores e operacoes que usam o mesmo arquivo, de modo que uma
+/// alteracao feita por um deles seja vista pelos demais sem recarregar o inode do disco
+typedef struct
+{
+    Inode *inode;                 // NULL se a posicao esta livre
+    Disk *disk;
+    unsigned int users;
+} OpenInode;
+
+/// Numero de threads que executam as operacoes assincronas
+#define ASYNC_NUM_WORKERS 4
+
+/// Operacao assincrona na fila de execucao, criada por myfsReadAsync ou myfsWriteAsync
+typedef struct AsyncRequest
+{
+    int fd;
+    bool write;
+    char *buf;
+    unsigned int nbytes;
+    unsigned int offset;
+    AsyncCallback callback;
+    void *arg;
+    struct AsyncRequest *next;
+} AsyncRequest;
+
+/// Fila de operacoes assincronas e threads que as executam, criadas na primeira operacao. lock protege a fila e os
+/// contadores; fsLock, recursiva, e mantida por cada funcao publica do myfs durante sua execucao, ja que as estruturas
+/// do myfs sao compartilhadas entre as threads
+typedef struct
+{
+    pthread_mutex_t lock;
+    pthread_cond_t workAvailable;
+    pthread_cond_t allDone;
+    pthread_mutex_t fsLock;
+    pthread_once_t fsLockInit;    // Inicializacao de fsLock, feita por __lockFs
+    AsyncRequest *head;
+    AsyncRequest *tail;
+    unsigned int pending;         // Operacoes na fila ou em execucao
+    unsigned int fdPending[MAX_FDS]; // Operacoes de cada descritor na fila ou em execucao, sem contar os callbacks
+    pthread_cond_t fdDone;
+    unsigned int numWorkers;
+    pthread_t workers[ASYNC_NUM_WORKERS];
+} AsyncPool;
+
 extern int myfsSlot;
 extern FSInfo myfsInfo;
 extern FileInfo* openFiles[MAX_FDS];
+extern MountInfo mounts[MAX_MOUNTS];
+extern OpenInode openInodes[MAX_OPEN_INODES];
+extern AsyncPool asyncPool;
+extern unsigned int fileGeneration;
 
 
 // Retorna o primeiro bit igual a 0 no byte de entrada, procurando do bit menos significativo para o mais significativo.
@@ -51,21 +259,477 @@ unsigned char __setBitToOne(unsigned char byte, unsigned int bit);
 unsigned char __setBitToZero(unsigned char byte, unsigned int bit);
 
 
+// Marca count blocos consecutivos do mapa de bits, a partir do bloco de indice firstIndex (contado a partir do inicio
+// da area de blocos), como ocupados (used = true) ou livres (used = false). Cada setor do mapa de bits envolvido e lido
+// e escrito apenas uma vez. Retorna true (!= 0) se a operacao foi bem sucedida e false (0) caso contrario
+bool __markBlockRange(Disk *d, unsigned int firstIndex, unsigned int count, bool used);
+
+
+// Retorna o contexto do disco d, lendo o superbloco e criando o contexto se este for o primeiro acesso ao disco desde
+// sua montagem ou formatacao. Se todas as posicoes estiverem ocupadas, reaproveita a de um disco sem arquivos
+// abertos. Retorna NULL se o disco nao estiver em formato myfs, se todas as posicoes forem de discos com arquivos
+// abertos ou em caso de erro
+MountInfo* __getMountInfo(Disk *d);
+
+
+// Descarta o contexto do disco d, se existir, de modo que o superbloco seja lido novamente no proximo acesso. Deve ser
+// chamada sempre que o superbloco ou o mapa de bits forem reescritos por fora das funcoes de alocacao
+void __releaseMountInfo(Disk *d);
+
+
+// Libera o estado em memoria da posicao mount da tabela de contextos e a deixa livre
+void __discardMountInfo(MountInfo *mount);
+
+
+// Garante que o resumo do mapa de bits do contexto mount esteja carregado, construindo-o com uma leitura sequencial do
+// mapa de bits se necessario. Retorna true (!= 0) em caso de sucesso e false (0) caso contrario
+bool __loadFreeSpaceSummary(MountInfo *mount);
+
+
+// Recalcula o resumo do setor sectorIndex do mapa de bits (contado a partir do primeiro setor do mapa) a partir do
+// conteudo atual do setor em bitmapSector. Nao faz nada se o resumo nao estiver carregado
+void __updateFreeSpaceSummary(MountInfo *mount, unsigned int sectorIndex, const unsigned char *bitmapSector);
+
+
+// Registra no resumo do mapa de bits do contexto mount a passagem do bloco de indice index (contado a partir do inicio
+// da area de blocos) para ocupado (used = true) ou livre (used = false), atualizando a contagem de blocos livres do seu
+// grupo. Deve ser chamada apenas quando o bit do bloco realmente muda. Nao faz nada se o resumo nao estiver carregado
+void __countGroupBlock(MountInfo *mount, unsigned int index, bool used);
+
+
+// Descarta o resumo do mapa de bits do contexto mount, forcando sua reconstrucao na proxima alocacao
+void __invalidateFreeSpaceSummary(MountInfo *mount);
+
+
+// Retorna o numero de blocos livres do disco d, ou 0 em caso de erro
+unsigned int __getNumFreeBlocks(Disk *d);
+
+
+// Retorna o tamanho, em blocos, da maior sequencia de blocos livres e contiguos do disco d, ou 0 em caso de erro
+unsigned int __getLargestFreeRun(Disk *d);
+
+
+// Compara duas extensoes livres na ordem da arvore tree: por posicao (EXTENT_BY_OFFSET) ou por tamanho e, em caso de
+// empate, por posicao (EXTENT_BY_LENGTH). Retorna um valor negativo, zero ou positivo, como em qsort
+int __compareExtents(const FreeExtent *a, const FreeExtent *b, int tree);
+
+
+// Retorna a altura da subarvore node na arvore tree, sendo 0 a altura de uma subarvore vazia
+int __extentHeight(FreeExtent *node, int tree);
+
+
+// Recalcula a altura de node na arvore tree a partir de seus filhos e, na arvore por posicao, o maior tamanho de
+// extensao da subarvore
+void __extentUpdate(FreeExtent *node, int tree);
+
+
+// Rotaciona a subarvore node da arvore tree para a esquerda (toLeft = true) ou para a direita. Retorna a nova raiz da
+// subarvore
+FreeExtent* __extentRotate(FreeExtent *node, int tree, bool toLeft);
+
+
+// Restaura o balanceamento AVL da subarvore node da arvore tree apos uma insercao ou remocao em um de seus filhos.
+// Retorna a nova raiz da subarvore
+FreeExtent* __extentBalance(FreeExtent *node, int tree);
+
+
+// Insere node na arvore tree de raiz root. Retorna a nova raiz da arvore
+FreeExtent* __extentInsert(FreeExtent *root, FreeExtent *node, int tree);
+
+
+// Remove da arvore tree de raiz root o menor no, escrito em *min. Retorna a nova raiz da arvore
+FreeExtent* __extentRemoveMin(FreeExtent *root, FreeExtent **min, int tree);
+
+
+// Remove node da arvore tree de raiz root, sem libera-lo. Retorna a nova raiz da arvore
+FreeExtent* __extentRemove(FreeExtent *root, FreeExtent *node, int tree);
+
+
+// Cria uma extensao livre com length blocos a partir do indice start e a insere nas duas arvores do contexto mount.
+// Retorna true (!= 0) em caso de sucesso e false (0) se nao houver memoria
+bool __addFreeExtent(MountInfo *mount, unsigned int start, unsigned int length);
+
+
+// Remove a extensao livre extent das duas arvores do contexto mount e a libera
+void __removeFreeExtent(MountInfo *mount, FreeExtent *extent);
+
+
+// Retorna a extensao livre de maior posicao que comeca no bloco de indice index ou antes dele, ou NULL se nao existir
+FreeExtent* __findExtentAtOrBefore(MountInfo *mount, unsigned int index);
+
+
+// Retorna a extensao livre de menor posicao, entre as que comecam no bloco de indice from ou depois dele, com pelo
+// menos count blocos. O maior tamanho guardado em cada subarvore permite descartar subarvores inteiras. Retorna NULL
+// se nao existir
+FreeExtent* __findExtentFrom(FreeExtent *root, unsigned int from, unsigned int count);
+
+
+// Escolhe, pela politica de alocacao do contexto mount, a extensao livre de onde count blocos serao reservados, com
+// goalIndex como ponto de partida da politica NEXT_FIT. Se nenhuma extensao tiver count blocos, escolhe a maior.
+// O numero de blocos disponiveis na posicao escolhida, limitado a count, e escrito em *length. Retorna o indice do
+// primeiro bloco escolhido, com *length igual a 0 se nao houver bloco livre
+unsigned int __findFreeExtent(MountInfo *mount, unsigned int goalIndex, unsigned int count, unsigned int *length);
+
+
+// Garante que as arvores de extensoes livres do contexto mount estejam carregadas, construindo-as com uma leitura
+// sequencial do mapa de bits se necessario. Retorna true (!= 0) em caso de sucesso e false (0) caso contrario
+bool __loadFreeExtents(MountInfo *mount);
+
+
+// Substitui as extensoes livres da faixa de blocos representada pelo setor sectorIndex do mapa de bits pelas
+// sequencias de bits 0 de bitmapSector, emendando-as com as extensoes vizinhas. Nao faz nada se as arvores nao
+// estiverem carregadas
+void __updateFreeExtents(MountInfo *mount, unsigned int sectorIndex, const unsigned char *bitmapSector);
+
+
+// Libera as arvores de extensoes livres do contexto mount, forcando sua reconstrucao na proxima alocacao que as use
+void __invalidateFreeExtents(MountInfo *mount);
+
+
 // Encontra um bloco livre no disco e o marca como ocupado se este estiver em formato myfs. Retorna 0 se nao houver
 // bloco livre ou se o disco nao estiver formatado corretamente
 unsigned int __findFreeBlock(Disk *d);
 
 
+// Reserva count blocos livres e contiguos, procurando a partir do bloco goal e dando a volta no disco se necessario.
+// Se nao existir sequencia livre com count blocos, reserva a maior sequencia encontrada. Com as politicas NEXT_FIT e
+// BEST_FIT a sequencia e escolhida pelas arvores de extensoes livres. O numero de blocos reservados e escrito em
+// *allocated. Retorna o endereco do primeiro bloco reservado ou 0 se nao houver bloco livre ou se o disco nao
+// estiver formatado corretamente
+unsigned int __findFreeBlocks(Disk *d, unsigned int goal, unsigned int count, unsigned int *allocated);
+
+
 // Dado um bloco em um disco formatado em myfs, marca o bloco como livre para uso. Retorna true (!= 0) se a operacao
 // foi bem sucedida e false (0) se algum erro ocorreu no processo
 bool __setBlockFree(Disk *d, unsigned int block);
 
 
-// Le e retorna o tamanho do bloco de um disco em bytes, assumindo que ele esteja formatado em myfs.
+// Dado o primeiro de count blocos contiguos em um disco formatado em myfs, marca todos como livres para uso. Retorna
+// true (!= 0) se a operacao foi bem sucedida e false (0) se algum erro ocorreu no processo
+bool __setBlocksFree(Disk *d, unsigned int block, unsigned int count);
+
+
+// Compara dois enderecos de bloco para qsort, em ordem crescente
+int __compareBlockAddr(const void *a, const void *b);
+
+
+// Marca como livres os count blocos cujos enderecos estao em blocks, em qualquer ordem. Os enderecos sao ordenados no
+// proprio vetor e agrupados por setor do mapa de bits, de modo que cada setor envolvido e lido e escrito apenas uma
+// vez. Retorna true (!= 0) se a operacao foi bem sucedida e false (0) se algum erro ocorreu no processo
+bool __setBlockListFree(Disk *d, unsigned int *blocks, unsigned int count);
+
+
+// Garante que a contagem de blocos compartilhados por setor da tabela de referencias do contexto mount esteja
+// alocada. Setores ainda nao lidos sao marcados como SHARED_COUNT_UNKNOWN. Retorna true (!= 0) em caso de sucesso e
+// false (0) caso contrario
+bool __loadSharedCounts(MountInfo *mount);
+
+
+// Le o setor sectorIndex da tabela de referencias do contexto mount em buffer, contando seus blocos compartilhados se
+// o setor ainda nao havia sido lido. Retorna true (!= 0) em caso de sucesso e false (0) caso contrario
+bool __readRefCountSector(MountInfo *mount, unsigned int sectorIndex, unsigned char *buffer);
+
+
+// Retorna o numero de referencias ao bloco do disco que guarda o bloco block alem da primeira, ou 0 se o bloco nao e
+// compartilhado, se o disco nao possui tabela de referencias ou em caso de erro
+unsigned int __getBlockRefs(Disk *d, unsigned int block);
+
+
+// Acrescenta uma referencia a cada um dos count blocos cujos enderecos estao em blocks, ordenando o vetor e trocando
+// enderecos de blocos comprimidos pelos blocos do disco que guardam seus dados. Buracos de arquivos esparsos sao
+// ignorados. Cada setor da tabela de referencias envolvido e lido e escrito apenas uma vez. Retorna true (!= 0) em caso
+// de sucesso e false (0) se o disco nao possui tabela de referencias ou em caso de erro
+bool __addBlockRefs(Disk *d, unsigned int *blocks, unsigned int count);
+
+
+// Retira uma referencia de cada bloco compartilhado do vetor ordenado de *count enderecos de blocks, todos da area de
+// blocos, removendo-o do vetor. Restam em blocks, na mesma ordem, os *count blocos sem outras referencias, que podem
+// ser liberados. Retorna true (!= 0) em caso de sucesso e false (0) caso contrario
+bool __dropBlockRefs(Disk *d, unsigned int *blocks, unsigned int *count);
+
+
+// Garante que os checksums da area de blocos do contexto mount estejam carregados, lendo em sequencia toda a area de
+// checksums se necessario. Se o superbloco marcar a area como desatualizada, os checksums sao descartados e os setores
+// deixam de ser verificados ate a proxima escrita. Retorna true (!= 0) em caso de sucesso e false (0) caso contrario
+bool __loadChecksums(MountInfo *mount);
+
+
+// Calcula o checksum de um setor de dados: o seu CRC32C com o bit menos significativo sempre 1, ja que 0 marca um
+// setor sem checksum
+unsigned int __sectorChecksum(const unsigned char *data);
+
+
+// Le o setor sector do disco d em data, como diskReadSector, e verifica o checksum dos setores da area de blocos.
+// Retorna 0 em caso de sucesso e -1 se a leitura falhar ou o conteudo nao corresponder ao checksum guardado
+int __readBlockSector(Disk *d, unsigned int sector, unsigned char *data);
+
+
+// Grava data no setor sector do disco d, como diskWriteSector, e atualiza em memoria o checksum dos setores da area de
+// blocos, que e gravado depois por __saveChecksums. A primeira alteracao ainda nao gravada marca antes a area de
+// checksums como desatualizada no superbloco. Retorna 0 em caso de sucesso e -1 caso contrario
+int __writeBlockSector(Disk *d, unsigned int sector, unsigned char *data);
+
+
+// Grava os setores modificados da area de checksums do disco d e volta a marca-la como em dia no superbloco. Retorna
+// true (!= 0) em caso de sucesso e false (0) caso contrario
+bool __saveChecksums(Disk *d);
+
+
+// Marca no superbloco do disco d a area de checksums como desatualizada (stale = true), enquanto houver checksums
+// alterados apenas em memoria, ou como em dia (stale = false). Uma parada sem myfsClose deixa a marca, e a proxima
+// montagem descarta os checksums em vez de acusar erro nos setores alterados. Retorna true (!= 0) em caso de sucesso
+// e false (0) caso contrario
+bool __markChecksumsStale(Disk *d, bool stale);
+
+
+// Obtem do contexto do disco a divisao em grupos de cilindros, escrevendo o numero de grupos em *numGroups, o numero
+// de blocos por grupo em *blocksPerGroup e o numero de inodes por grupo em *inodesPerGroup. Discos formatados sem
+// grupos sao tratados como um unico grupo. Retorna true (!= 0) em caso de sucesso e false (0) caso contrario
+bool __getGroupLayout(Disk *d, unsigned int *numGroups, unsigned int *blocksPerGroup, unsigned int *inodesPerGroup);
+
+
+// Retorna o endereco do primeiro bloco do grupo de cilindros ao qual pertence o inode de numero inumber, usado como
+// ponto de partida para a alocacao dos blocos do arquivo. Retorna 0 em caso de erro
+unsigned int __getGroupFirstBlock(Disk *d, unsigned int inumber);
+
+
+// Encontra um inode livre para um novo arquivo criado no diretorio de inode parentInumber. Arquivos comuns ficam no
+// grupo de cilindros do diretorio pai e novos diretorios vao para o grupo com mais blocos livres, espalhando-os pelo
+// disco. Se o grupo escolhido nao tiver inodes livres, procura nos demais. Retorna 0 se nao houver inode livre
+unsigned int __findFreeInode(Disk *d, unsigned int parentInumber, bool isDir);
+
+
+// Retorna o tamanho do bloco de um disco em bytes, assumindo que ele esteja formatado em myfs.
 // Retorna 0 em caso de erro
 unsigned int __getBlockSize(Disk *d);
 
 
+// Le diretamente do disco os itens do inode de numero inumber, seguindo o layout definido em inode.c. Usado para
+// percorrer extensoes de inodes, cujos enderecos alem do oitavo nao sao acessiveis pela API de inode.h. Retorna
+// true (!= 0) em caso de sucesso e false (0) caso contrario
+bool __readInodeItems(Disk *d, unsigned int inumber, unsigned int items[INODE_NUM_ITEMS]);
+
+
+// Retorna o endereco do bloco de numero blockNum de um arquivo ou 0 se o arquivo nao possuir esse bloco. Ao
+// contrario de inodeGetBlockAddr, pode ser usada para blocos alem do fim da cadeia de extensoes do inode
+unsigned int __getBlockAddr(Disk *d, Inode *inode, unsigned int blockNum);
+
+
+// Escreve em blocks os enderecos dos count blocos de um arquivo a partir do bloco de numero firstBlock, percorrendo as
+// extensoes do inode uma unica vez. Blocos alem do fim do mapa recebem 0. Retorna true (!= 0) em caso de sucesso e
+// false (0) caso contrario
+bool __getBlockRange(Disk *d, Inode *inode, unsigned int firstBlock, unsigned int count, unsigned int *blocks);
+
+
+// Registra extNumber como a proxima extensao da cadeia de extensoes percorrida pelo descritor file. Retorna true
+// (!= 0) em caso de sucesso e false (0) se faltar memoria
+bool __addFileExtension(FileInfo *file, unsigned int extNumber);
+
+
+// Le em items os itens da extensao de indice extIndex (0 para a primeira) do arquivo aberto file. Extensoes ja
+// percorridas pelo descritor sao lidas diretamente; as demais sao alcancadas a partir da ultima conhecida e
+// registradas. Se a cadeia terminar antes da extensao, items e zerado. Retorna true (!= 0) em caso de sucesso e false
+// (0) caso contrario
+bool __readFileExtension(FileInfo *file, unsigned int extIndex, unsigned int items[INODE_NUM_ITEMS]);
+
+
+// Escreve em blocks os enderecos dos count blocos do arquivo aberto file a partir do bloco de numero firstBlock, como
+// __getBlockRange, mas lendo apenas as extensoes que guardam os blocos procurados quando o descritor ja as conhece.
+// Retorna true (!= 0) em caso de sucesso e false (0) caso contrario
+bool __getFileBlockRange(FileInfo *file, unsigned int firstBlock, unsigned int count, unsigned int *blocks);
+
+
+// Retorna o endereco do bloco de numero blockNum do arquivo aberto file, buscado como em __getFileBlockRange, ou 0 se
+// o arquivo nao possuir esse bloco ou em caso de erro
+unsigned int __getFileBlockAddr(FileInfo *file, unsigned int blockNum);
+
+
+// Altera para addr o endereco do bloco de numero blockNum de um arquivo, gravando a extensao que o contem. So vale para
+// blocos guardados em extensoes, ja que os do inode principal sao mantidos pelo inode em memoria. Retorna true (!= 0)
+// em caso de sucesso e false (0) caso contrario
+bool __setBlockAddr(Disk *d, Inode *inode, unsigned int blockNum, unsigned int addr);
+
+
+// Retorna o endereco do bloco do disco d que guarda o endereco addr de um mapa de blocos: o proprio addr, ou, para um
+// bloco comprimido, o bloco que contem o primeiro setor dos seus dados. Retorna 0 em caso de erro
+unsigned int __getPhysicalBlock(Disk *d, unsigned int addr);
+
+
+// Grava diretamente no disco os itens do inode de numero inumber, seguindo o layout definido em inode.c. Retorna
+// true (!= 0) em caso de sucesso e false (0) caso contrario
+bool __writeInodeItems(Disk *d, unsigned int inumber, unsigned int items[INODE_NUM_ITEMS]);
+
+
+// Limpa os count inodes de inumbers, que passam a ser considerados livres. Inodes do mesmo setor da area de inodes sao
+// limpos com uma unica leitura e escrita do setor. O vetor e ordenado no processo. Retorna true (!= 0) em caso de
+// sucesso e false (0) caso contrario
+bool __clearInodeList(Disk *d, unsigned int *inumbers, unsigned int count);
+
+
+// Retorna o numero de inodes do disco, assumindo que ele esteja formatado em myfs. Retorna 0 em caso de erro
+unsigned int __getNumInodes(Disk *d);
+
+
+// Le todo o mapa de blocos de um arquivo, percorrendo a cadeia de extensoes do inode uma unica vez. O numero de
+// blocos e escrito em *numBlocks. Retorna um vetor alocado dinamicamente com os enderecos dos blocos, que deve ser
+// liberado com free, ou NULL em caso de erro
+unsigned int* __loadBlockMap(Disk *d, Inode *inode, unsigned int *numBlocks);
+
+
+// Adiciona count enderecos de bloco ao fim do mapa de blocos de um arquivo. Enderecos que cabem em extensoes sao
+// gravados diretamente, com uma unica escrita por extensao, em vez de percorrer a cadeia a cada bloco como
+// inodeAddBlock. Retorna o numero de enderecos efetivamente adicionados
+unsigned int __appendBlocks(Disk *d, Inode *inode, const unsigned int *blocks, unsigned int count);
+
+
+// Reduz o mapa de blocos do arquivo de inode inode aos seus primeiros keepBlocks blocos (ao menos 1). Os blocos
+// descartados sao liberados com uma unica atualizacao do mapa de bits e as extensoes que ficam vazias sao limpas em
+// lote. Retorna true (!= 0) em caso de sucesso e false (0) caso contrario
+bool __truncateBlockMap(Disk *d, Inode *inode, unsigned int keepBlocks);
+
+
+// Reserva count blocos, preferencialmente contiguos e a partir do bloco goal, escrevendo seus enderecos em blocks.
+// Se nao houver uma unica sequencia livre grande o suficiente, usa as maiores sequencias disponiveis. Retorna o numero
+// de blocos reservados, menor que count apenas se o disco estiver cheio
+unsigned int __reserveBlocks(Disk *d, unsigned int goal, unsigned int count, unsigned int *blocks);
+
+
+// Retorna o inode inumber do disco d em memoria, carregando-o do disco apenas se nenhum descritor ou operacao o estiver
+// usando. Quem o obtem deve devolve-lo com __releaseInode em vez de libera-lo com free. Se a tabela de inodes em
+// memoria estiver cheia, retorna uma copia propria, que nao e vista pelos demais usuarios. Retorna NULL em caso de erro
+Inode* __acquireInode(Disk *d, unsigned int inumber);
+
+
+// Devolve um inode obtido com __acquireInode, liberando sua memoria quando ele deixa de ser usado. Alteracoes devem ser
+// gravadas com inodeSave antes, pois o inode nao e salvo aqui
+void __releaseInode(Inode *inode);
+
+
+// Cria a estrutura de um arquivo aberto no disco d, com o cursor no inicio do arquivo e sem dados pendentes. Retorna
+// NULL se nao houver memoria suficiente
+FileInfo* __newFileInfo(Disk *d, unsigned int blockSize, Inode *inode);
+
+
+// Retorna o numero de blocos associados ao inode de acordo com o tamanho do arquivo. Todo arquivo possui ao menos um
+// bloco, reservado na sua criacao
+unsigned int __getNumFileBlocks(Inode *inode, unsigned int blockSize);
+
+
+// Retorna o tamanho do arquivo aberto file, contando os dados que ainda aguardam a alocacao atrasada
+unsigned int __getFileSize(FileInfo *file);
+
+
+// Retorna o numero total de bytes dos iovcnt trechos de iov, ou -1 se o vetor for invalido ou o total nao couber no
+// retorno de myfsRead e myfsWrite
+long __getIovecLength(const struct iovec *iov, int iovcnt);
+
+
+// Grava no disco os setores modificados do bloco em cache do arquivo file, que continua em cache. Retorna true (!= 0)
+// em caso de sucesso e false (0) caso contrario
+bool __flushBlockCache(FileInfo *file);
+
+
+// Grava os setores modificados do bloco block no cache de qualquer outro arquivo aberto no mesmo disco de file e, se
+// drop for true, retira o bloco desses caches. Deve ser chamada antes de file acessar o bloco fora de seu proprio
+// cache (drop = false) ou de modifica-lo (drop = true), pois cada descritor possui seu cache. Retorna true (!= 0) em
+// caso de sucesso e false (0) caso contrario
+bool __syncBlockCaches(FileInfo *file, unsigned int block, bool drop);
+
+
+// Coloca no cache de file o bloco block, de numero blockNum no mapa de blocos do arquivo, gravando antes o bloco que
+// ocupava o cache. Blocos comprimidos sao descomprimidos, e setores alem do fim do arquivo sao zerados em vez de lidos.
+// forWrite indica que o bloco sera modificado. Retorna o conteudo do bloco em cache ou NULL em caso de erro
+unsigned char* __loadBlockCache(FileInfo *file, unsigned int blockNum, unsigned int block, bool forWrite);
+
+
+// Coloca no cache de file o bloco block, recem associado ao arquivo, com todos os bytes zerados e marcados como
+// modificados, sem ler o disco. Retorna o conteudo do bloco em cache ou NULL em caso de erro
+unsigned char* __zeroBlockCache(FileInfo *file, unsigned int block);
+
+
+// Coloca no cache de file o conteudo do bloco block, de numero blockNum no mapa de blocos do arquivo, como conteudo do
+// bloco newBlock, que o substitui no arquivo. Todos os bytes ficam marcados como modificados, de modo que a copia seja
+// gravada em newBlock. Retorna o conteudo do bloco em cache ou NULL em caso de erro
+unsigned char* __copyBlockCache(FileInfo *file, unsigned int blockNum, unsigned int block, unsigned int newBlock);
+
+
+// Descarta a leitura antecipada e a cadeia de extensoes conhecida de todos os descritores abertos do mesmo arquivo de
+// file, identificados pelo disco e pelo numero do inode, ja que um descritor pode usar uma copia propria do inode, e
+// renova suas geracoes, invalidando os mapeamentos feitos sobre eles. Deve ser chamada antes de qualquer alteracao no
+// conteudo ou no mapa de blocos do arquivo
+void __dropReadAhead(FileInfo *file);
+
+
+// Traz para a leitura antecipada de file os blocos do arquivo a partir do bloco de numero blockNum, ate a janela atual
+// ou o fim do arquivo. Os blocos sao lidos em ordem de endereco no disco; buracos e setores alem do fim do arquivo sao
+// zerados, e o bloco no cache do proprio arquivo e copiado dele. Retorna true (!= 0) em caso de sucesso e false (0)
+// caso contrario, em que a leitura antecipada fica vazia
+bool __fillReadAhead(FileInfo *file, unsigned int blockNum);
+
+
+// Escreve nbytes de buf nos blocos do arquivo, a partir de file->currentByte, alocando novos blocos contiguos quando
+// necessario. Trechos que nao cobrem setores inteiros passam pelo cache de bloco do arquivo. Avanca o cursor e atualiza
+// o tamanho do arquivo. Retorna o numero de bytes escritos ou -1 em caso de erro de leitura ou escrita no disco
+int __writeBlocks(FileInfo *file, const char *buf, unsigned int nbytes);
+
+
+// Copia nbytes de buf para o buffer de alocacao atrasada do arquivo, a partir de file->currentByte. Se o limite
+// DELAYED_ALLOCATION_LIMIT ja tiver sido atingido, os dados pendentes sao gravados e nada e copiado. Retorna o numero
+// de bytes copiados ou -1 em caso de erro
+int __writeDelayed(FileInfo *file, const char *buf, unsigned int nbytes);
+
+
+// Calcula o hash de 64 bits dos size bytes de data, com size multiplo de 8, usado pelo indice de deduplicacao. Le os
+// dados 8 bytes por vez, de modo que o custo por bloco e pequeno perto de sua gravacao
+unsigned long long __hashBlock(const unsigned char *data, unsigned int size);
+
+
+// Verifica se o bloco block do indice de deduplicacao, comprimido ou nao, ainda tem o conteudo data. O bloco pode ter
+// sido modificado depois de indexado, entao ele e lido, apos a gravacao de alteracoes pendentes nos caches, e
+// comparado byte a byte. buffer deve ter o tamanho de um bloco. Retorna true (!= 0) se o conteudo for igual e false (0)
+// se for diferente ou ocorrer algum erro
+bool __matchDedupBlock(FileInfo *file, unsigned int block, const unsigned char *data, unsigned char *buffer);
+
+
+// Retira do indice de deduplicacao do contexto mount as entradas cujos dados estao em algum dos count blocos do vetor
+// ordenado blocks, que estao sendo liberados
+void __forgetDedupBlocks(MountInfo *mount, const unsigned int *blocks, unsigned int count);
+
+
+// Acrescenta ao indice de deduplicacao do contexto mount o bloco block, de hash hash. O bloco ocupa uma entrada vazia
+// ou com o mesmo hash do seu conjunto, ou, na falta delas, substitui uma entrada escolhida pelo proprio hash
+void __indexDedupBlock(MountInfo *mount, unsigned long long hash, unsigned int block);
+
+
+// Grava os dados pendentes de alocacao atrasada do arquivo, escrevendo em entries o endereco de cada bloco para o mapa
+// de blocos, a partir do objetivo goal. Os blocos das extensoes do inode sao deduplicados e comprimidos conforme o modo
+// do disco; os do inode principal sao sempre gravados como estao. Um bloco igual a outro dos dados pendentes ou a um
+// bloco do indice de deduplicacao passa a compartilha-lo. Blocos que nao economizam ao menos um setor sao gravados sem
+// compressao, e os comprimidos sao agrupados em sequencia nos mesmos blocos do disco. Cada endereco alem do primeiro
+// que aponta para um bloco do disco acrescenta uma referencia a ele. Retorna o numero de enderecos escritos em entries,
+// menor que o numero de blocos pendentes se faltar espaco em disco, ou 0 em caso de erro
+unsigned int __writePackedData(FileInfo *file, unsigned int goal, unsigned int *entries);
+
+
+// Aloca de uma so vez os blocos necessarios para os dados pendentes de alocacao atrasada do arquivo, grava esses
+// dados e atualiza o tamanho do arquivo. Retorna true (!= 0) em caso de sucesso e false (0) se faltar espaco em disco
+// ou ocorrer algum erro, caso em que os dados que nao couberam sao descartados
+bool __flushDelayedData(FileInfo *file);
+
+
+// Grava os dados pendentes de alocacao atrasada dos demais descritores abertos do mesmo arquivo de file, de modo que
+// leituras, escritas e consultas ao tamanho feitas por file vejam esses dados. Retorna true (!= 0) em caso de sucesso e
+// false (0) caso contrario
+bool __flushOtherDelayedData(FileInfo *file);
+
+
+// Estende o arquivo file ate newSize bytes sem gravar dados, antes de uma escrita alem do fim do arquivo. O trecho
+// acrescentado le como zeros: os blocos que o arquivo ja possui e os do inode principal sao zerados, e os demais viram
+// buracos (HOLE_BLOCK) no mapa de blocos, sem ocupar espaco em disco. Retorna true (!= 0) em caso de sucesso e false
+// (0) caso contrario
+bool __extendFile(FileInfo *file, unsigned int newSize);
+
+
 // Funciona como um openDir para o diretorio raiz de um disco. Pode ser fechado normalmnte atraves de myfsClosedir.
 // Retorna um descritor de arquivo em caso de sucesso e -1 em caso de erro
 int __openRoot(Disk *d);
@@ -91,4 +755,130 @@ bool __deleteDir(Disk *d, Inode *inode, Inode *parent);
 bool __autoLink(int fd);
 
 
+// Le todas as entradas do diretorio referente ao inode dir, percorrendo seu mapa de blocos diretamente. O numero de
+// entradas e escrito em *numEntries. Retorna um vetor alocado dinamicamente, que deve ser liberado com free, ou NULL
+// em caso de erro
+DirectoryEntry* __loadDirEntries(Disk *d, Inode *dir, unsigned int *numEntries);
+
+
+// Substitui os enderecos do mapa de blocos do inode de numero inumber pelos count enderecos de blocks, mantendo a
+// mesma cadeia de extensoes. count deve ser igual ao numero de blocos do mapa atual. Cada inode da cadeia e escrito
+// apenas uma vez. Retorna true (!= 0) em caso de sucesso e false (0) caso contrario
+bool __replaceBlockMap(Disk *d, unsigned int inumber, const unsigned int *blocks, unsigned int count);
+
+
+// Retorna o numero de sequencias contiguas no vetor de count enderecos de bloco blocks, em que cada bloco ocupa
+// sectorsPerBlock setores. Um arquivo sem fragmentacao tem uma unica sequencia
+unsigned int __countBlockRuns(const unsigned int *blocks, unsigned int count, unsigned int sectorsPerBlock);
+
+
+// Estima quantos cilindros as cabecas do disco percorrem para ler em ordem os count blocos de blocks, partindo do
+// cilindro do primeiro bloco
+unsigned long __estimateSeekCylinders(Disk *d, const unsigned int *blocks, unsigned int count);
+
+
+// Retorna true (!= 0) se o inode de numero inumber do disco d estiver aberto em algum descritor de arquivo
+bool __isInodeOpen(Disk *d, unsigned int inumber);
+
+
+// Move os blocos do arquivo de inode inumber para uma unica sequencia contigua, se ele estiver fragmentado e tiver
+// no maximo maxBlocks blocos. Os dados sao copiados antes de o mapa de blocos ser atualizado e os blocos antigos so
+// sao liberados depois, de modo que uma falha no meio do processo nunca deixa o mapa apontando para dados
+// incompletos. Atualiza report com a fragmentacao antes e depois. Retorna o numero de blocos movidos, 0 se o arquivo
+// foi mantido como estava
+unsigned int __defragFile(Disk *d, unsigned int inumber, unsigned int maxBlocks, DefragReport *report);
+
+
+// Le do disco a pagina page do mapeamento map para data, zerando os bytes alem do fim do arquivo. Modificacoes do bloco
+// ainda no cache de algum descritor sao gravadas antes. Retorna true (!= 0) em caso de sucesso e false (0) caso
+// contrario
+bool __readMappedPage(FileMapping *map, unsigned int page, unsigned char *data);
+
+
+// Le para data numSectors setores do arquivo file, a partir do setor firstSector contado do inicio do arquivo, usando
+// o mapa de blocos blocks de numBlocks enderecos ja carregado. Buracos e setores alem do mapa leem como zeros, e o
+// bloco em cache no descritor e lido do cache. Retorna true (!= 0) em caso de sucesso e false (0) caso contrario
+bool __readFileSectors(FileInfo *file, const unsigned int *blocks, unsigned int numBlocks, unsigned int firstSector,
+                       unsigned int numSectors, unsigned char *data);
+
+
+// Escreve em out, a partir da posicao *position, o restante length de um tamanho de literais ou de repeticao do
+// formato LZ4 que nao coube nos 4 bits do token: bytes 255 seguidos de um byte final menor que 255
+void __writeLzLength(unsigned char *out, unsigned int *position, unsigned int length);
+
+
+// Retorna o numero de bytes que um tamanho de literais ou de repeticao do formato LZ4, ja descontado o minimo da
+// repeticao, ocupa alem dos 4 bits do token: 0 se length cabe no token, ou os bytes escritos por __writeLzLength
+unsigned int __lzLengthBytes(unsigned int length);
+
+
+// Comprime os size bytes de data no formato de bloco do LZ4: sequencias de um token, literais copiados e uma
+// repeticao de pelo menos LZ_MIN_MATCH bytes, dada pela distancia (2 bytes) ate uma ocorrencia anterior. As
+// repeticoes sao encontradas por uma tabela de hash dos ultimos 4 bytes, sem busca de alternativas. Retorna o
+// tamanho dos dados comprimidos em out, ou 0 se eles nao couberem em capacity bytes
+unsigned int __compressBlock(const unsigned char *data, unsigned int size, unsigned char *out, unsigned int capacity);
+
+
+// Descomprime os dados de in, no formato de bloco do LZ4, ate preencher os size bytes de data. Bytes de in alem do fim
+// dos dados comprimidos sao ignorados. Retorna true (!= 0) em caso de sucesso e false (0) se os dados comprimidos
+// forem invalidos ou terminarem antes de preencher data
+bool __decompressBlock(const unsigned char *in, unsigned int inSize, unsigned char *data, unsigned int size);
+
+
+// Le do disco d o bloco comprimido de endereco addr (com COMPRESSED_BLOCK_FLAG) e o descomprime nos blockSize bytes de
+// data. Retorna true (!= 0) em caso de sucesso e false (0) caso contrario
+bool __readCompressedBlock(Disk *d, unsigned int addr, unsigned int blockSize, unsigned char *data);
+
+
+// Atualiza o CRC32C crc, ainda sem a inversao final, com os size bytes de data, usando as tabelas crc32cTable.
+// Retorna o CRC atualizado
+unsigned int __crc32cSoftware(unsigned int crc, const unsigned char *data, unsigned int size);
+
+
+#ifdef CRC32C_SSE42
+// Atualiza o CRC32C crc, ainda sem a inversao final, com os size bytes de data, usando a instrucao crc32 do SSE4.2
+// sobre 8 bytes por vez. So deve ser chamada se o processador possuir SSE4.2. Retorna o CRC atualizado
+unsigned int __crc32cHardware(unsigned int crc, const unsigned char *data, unsigned int size);
+#endif
+
+
+// Calcula o CRC32C (polinomio de Castagnoli) dos size bytes de data, com a instrucao do processador quando disponivel
+unsigned int __crc32c(const unsigned char *data, unsigned int size);
+
+
+// Inicializa fsLock como uma trava recursiva, que a thread que a possui pode obter de novo, ja que as funcoes publicas
+// do myfs chamam umas as outras. Executada uma unica vez, pela primeira chamada de __lockFs
+void __initFsLock(void);
+
+
+// Obtem fsLock, mantida por cada funcao publica do myfs durante sua execucao
+void __lockFs(void);
+
+
+// Libera fsLock, obtida por __lockFs
+void __unlockFs(void);
+
+
+// Executa a operacao assincrona request, ja retirada da fila, e chama o seu callback apos o termino, fora das travas,
+// de modo que ele possa enfileirar novas operacoes ou chamar qualquer outra funcao do myfs. Libera request
+void __runAsyncRequest(AsyncRequest *request);
+
+
+// Executa as operacoes da fila de operacoes assincronas, uma de cada vez, chamando o callback de cada uma apos o seu
+// termino. Funcao de cada thread do conjunto, que nunca retorna
+void* __asyncWorker(void *arg);
+
+
+// Coloca request no fim da fila de operacoes assincronas, criando as threads do conjunto na primeira chamada. Retorna
+// true (!= 0) em caso de sucesso e false (0) se o descritor nao estiver aberto ou nenhuma thread puder ser criada,
+// casos em que request nao e enfileirada
+bool __submitAsync(AsyncRequest *request);
+
+
+// Espera o fim das operacoes assincronas do descritor fd, antes de ele ser fechado. As operacoes ainda na fila sao
+// retiradas dela e executadas pela propria thread, de modo que a espera termine mesmo quando chamada pelos callbacks de
+// todas as threads do conjunto; apenas as ja em execucao sao esperadas. Nao deve ser chamada com fsLock mantido, que
+// as operacoes em execucao precisam obter
+void __waitAsyncRequests(int fd);
+
 #endif //SO_TRABALHO2_MYFSINTERNALFUNCTIONS_H